@@ -0,0 +1,422 @@
+#include "AudioProbe.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+static uint32_t readBE32(const unsigned char *p) {
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+         ((uint32_t)p[2] << 8) | p[3];
+}
+
+static uint16_t readLE16(const unsigned char *p) {
+  return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t readLE32(const unsigned char *p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) |
+         ((uint32_t)p[3] << 24);
+}
+
+static uint64_t readLE64(const unsigned char *p) {
+  return (uint64_t)readLE32(p) | ((uint64_t)readLE32(p + 4) << 32);
+}
+
+size_t id3v2TagSize(const unsigned char *data, size_t size) {
+  if (size < 10 || memcmp(data, "ID3", 3) != 0)
+    return 0;
+  // Syncsafe integer: 7 bits per byte.
+  size_t tagSize = ((size_t)(data[6] & 0x7F) << 21) |
+                   ((size_t)(data[7] & 0x7F) << 14) |
+                   ((size_t)(data[8] & 0x7F) << 7) | (data[9] & 0x7F);
+  size_t footer = (data[5] & 0x10) ? 10 : 0;
+  return 10 + tagSize + footer;
+}
+
+// --- MP3 ---
+
+struct Mp3Frame {
+  int version; // 3 = MPEG1, 2 = MPEG2, 0 = MPEG2.5
+  int layer;   // 1..3
+  uint32_t bitrate;
+  uint32_t sampleRate;
+  uint32_t channels;
+  uint32_t length;
+  uint32_t samples;
+};
+
+static bool parseMp3Header(const unsigned char *p, Mp3Frame &frame) {
+  static const uint16_t bitrates[5][16] = {
+      {0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448},
+      {0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384},
+      {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320},
+      {0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256},
+      {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160}};
+  static const uint32_t rates[3] = {44100, 48000, 32000};
+
+  if (p[0] != 0xFF || (p[1] & 0xE0) != 0xE0)
+    return false;
+  int version = (p[1] >> 3) & 3;
+  int layerBits = (p[1] >> 1) & 3;
+  int bitrateIndex = p[2] >> 4;
+  int rateIndex = (p[2] >> 2) & 3;
+  if (version == 1 || layerBits == 0 || bitrateIndex == 0 ||
+      bitrateIndex == 15 || rateIndex == 3)
+    return false;
+
+  frame.version = version;
+  frame.layer = 4 - layerBits;
+  int table = version == 3 ? frame.layer - 1 : (frame.layer == 1 ? 3 : 4);
+  frame.bitrate = bitrates[table][bitrateIndex] * 1000;
+  frame.sampleRate = rates[rateIndex] >> (version == 3 ? 0 : version == 2 ? 1 : 2);
+  frame.channels = (p[3] >> 6) == 3 ? 1 : 2;
+
+  uint32_t padding = (p[2] >> 1) & 1;
+  if (frame.layer == 1) {
+    frame.samples = 384;
+    frame.length = (12 * frame.bitrate / frame.sampleRate + padding) * 4;
+  } else if (frame.layer == 3 && version != 3) {
+    frame.samples = 576;
+    frame.length = 72 * frame.bitrate / frame.sampleRate + padding;
+  } else {
+    frame.samples = 1152;
+    frame.length = 144 * frame.bitrate / frame.sampleRate + padding;
+  }
+  return frame.length >= 4;
+}
+
+// The first header that is followed by another one of the same stream, so
+// stray 0xFF bytes in leftover tag data are not mistaken for audio.
+static bool findMp3Frame(const unsigned char *data, size_t size,
+                         size_t &offset, Mp3Frame &frame) {
+  for (size_t i = 0; i + 4 <= size; ++i) {
+    if (data[i] != 0xFF || !parseMp3Header(data + i, frame))
+      continue;
+    size_t next = i + frame.length;
+    Mp3Frame second;
+    if (next + 4 <= size &&
+        (!parseMp3Header(data + next, second) ||
+         second.version != frame.version || second.layer != frame.layer ||
+         second.sampleRate != frame.sampleRate))
+      continue;
+    offset = i;
+    return true;
+  }
+  return false;
+}
+
+static bool probeMp3(const unsigned char *head, size_t headSize,
+                     uint64_t headOffset, const unsigned char *tail,
+                     size_t tailSize, uint64_t fileSize,
+                     AudioProbeInfo &info) {
+  size_t offset;
+  Mp3Frame frame;
+  if (!findMp3Frame(head, headSize, offset, frame))
+    return false;
+
+  info.sampleRate = frame.sampleRate;
+  info.channels = frame.channels;
+  const unsigned char *p = head + offset;
+  size_t avail = headSize - offset;
+
+  // Xing/Info sits right after the side info of the first frame.
+  size_t sideInfo = frame.version == 3 ? (frame.channels == 1 ? 17 : 32)
+                                       : (frame.channels == 1 ? 9 : 17);
+  size_t xing = 4 + sideInfo;
+  if (avail >= xing + 8 && (memcmp(p + xing, "Xing", 4) == 0 ||
+                            memcmp(p + xing, "Info", 4) == 0)) {
+    uint32_t flags = readBE32(p + xing + 4);
+    size_t field = xing + 8;
+    uint64_t frames = 0;
+    if ((flags & 1) && avail >= field + 4) {
+      frames = readBE32(p + field);
+      field += 4;
+    }
+    if (flags & 2)
+      field += 4;
+    if (flags & 4)
+      field += 100;
+    if (flags & 8)
+      field += 4;
+    if (frames > 0) {
+      uint64_t samples = frames * frame.samples;
+      // LAME (and ffmpeg's compatible tag) record encoder delay and
+      // padding, which the decoder trims.
+      if (avail >= field + 24 && (memcmp(p + field, "LAME", 4) == 0 ||
+                                  memcmp(p + field, "Lavf", 4) == 0 ||
+                                  memcmp(p + field, "Lavc", 4) == 0)) {
+        const unsigned char *lame = p + field;
+        uint32_t delay = (lame[21] << 4) | (lame[22] >> 4);
+        uint32_t pad = ((lame[22] & 0x0F) << 8) | lame[23];
+        if (delay + pad < samples)
+          samples -= delay + pad;
+      }
+      info.lengthFrames = samples;
+      return true;
+    }
+  }
+
+  // VBRI is always 32 bytes after the header.
+  if (avail >= 4 + 32 + 18 && memcmp(p + 36, "VBRI", 4) == 0) {
+    uint64_t frames = readBE32(p + 36 + 14);
+    if (frames > 0) {
+      info.lengthFrames = frames * frame.samples;
+      return true;
+    }
+  }
+
+  // No VBR header: estimate from the average bitrate of the frames that
+  // were read. The first frame is skipped when there are others, since
+  // encoders often write it at a different rate.
+  uint64_t frameBytes = 0;
+  uint64_t frameSamples = 0;
+  size_t pos = offset + frame.length;
+  Mp3Frame next;
+  while (pos + 4 <= headSize && parseMp3Header(head + pos, next) &&
+         next.sampleRate == frame.sampleRate) {
+    frameBytes += next.length;
+    frameSamples += next.samples;
+    pos += next.length;
+  }
+  if (frameSamples == 0) {
+    frameBytes = frame.length;
+    frameSamples = frame.samples;
+  }
+
+  uint64_t audioStart = headOffset + offset;
+  uint64_t audioEnd = fileSize;
+  if (tailSize >= 128 && memcmp(tail + tailSize - 128, "TAG", 3) == 0)
+    audioEnd -= 128;
+  if (audioEnd <= audioStart)
+    return false;
+  info.lengthFrames = (audioEnd - audioStart) * frameSamples / frameBytes;
+  info.estimated = true;
+  return true;
+}
+
+// --- FLAC ---
+
+static bool parseStreamInfo(const unsigned char *p, AudioProbeInfo &info) {
+  info.sampleRate = (p[10] << 12) | (p[11] << 4) | (p[12] >> 4);
+  info.channels = ((p[12] >> 1) & 7) + 1;
+  info.lengthFrames = ((uint64_t)(p[13] & 0x0F) << 32) | readBE32(p + 14);
+  return info.sampleRate > 0;
+}
+
+static bool probeFlac(const unsigned char *head, size_t headSize,
+                      AudioProbeInfo &info) {
+  // "fLaC", then STREAMINFO is always the first metadata block.
+  if (headSize < 8 + 34 || (head[4] & 0x7F) != 0)
+    return false;
+  // A total of 0 means the encoder did not know it; nothing to fall back on.
+  return parseStreamInfo(head + 8, info) && info.lengthFrames > 0;
+}
+
+// --- WAV ---
+
+// RIFF, or RF64 for files past 4 GB: its data chunk's size is 0xFFFFFFFF
+// and the real one is in a "ds64" chunk ahead of it.
+static bool probeWav(const unsigned char *head, size_t headSize,
+                     uint64_t fileSize, AudioProbeInfo &info) {
+  bool rf64 = memcmp(head, "RF64", 4) == 0;
+  uint64_t ds64DataSize = 0;
+  uint32_t blockAlign = 0;
+  uint64_t pos = 12;
+  while (pos + 8 <= headSize) {
+    const unsigned char *chunk = head + pos;
+    uint64_t chunkSize = readLE32(chunk + 4);
+    if (rf64 && memcmp(chunk, "ds64", 4) == 0 && pos + 8 + 16 <= headSize) {
+      ds64DataSize = readLE64(chunk + 8 + 8); // After the RIFF size
+    } else if (memcmp(chunk, "fmt ", 4) == 0 && pos + 8 + 16 <= headSize) {
+      info.channels = readLE16(chunk + 8 + 2);
+      info.sampleRate = readLE32(chunk + 8 + 4);
+      blockAlign = readLE16(chunk + 8 + 12);
+    } else if (memcmp(chunk, "data", 4) == 0) {
+      if (blockAlign == 0 || info.sampleRate == 0)
+        return false;
+      if (rf64 && chunkSize == 0xFFFFFFFFu)
+        chunkSize = ds64DataSize;
+      uint64_t available = fileSize - std::min(fileSize, pos + 8);
+      // Streamed writers leave 0 or 0xFFFFFFFF when they cannot seek back.
+      if (chunkSize == 0 || chunkSize > available) {
+        chunkSize = available;
+        info.estimated = true;
+      }
+      info.lengthFrames = chunkSize / blockAlign;
+      return true;
+    }
+    pos += 8 + chunkSize + (chunkSize & 1);
+  }
+
+  // The data chunk starts past what was read (large LIST or padding
+  // chunks); everything after the last known chunk is taken as audio.
+  if (blockAlign == 0 || info.sampleRate == 0 || pos >= fileSize)
+    return false;
+  info.lengthFrames = (fileSize - pos) / blockAlign;
+  info.estimated = true;
+  return true;
+}
+
+// --- Ogg ---
+
+static bool probeOgg(const unsigned char *head, size_t headSize,
+                     const unsigned char *tail, size_t tailSize,
+                     AudioProbeInfo &info) {
+  if (headSize < 28)
+    return false;
+  uint32_t serial = readLE32(head + 14);
+  size_t packet = 27 + head[26];
+  if (packet + 19 > headSize)
+    return false;
+  const unsigned char *p = head + packet;
+
+  uint64_t preSkip = 0;
+  if (memcmp(p, "\x01vorbis", 7) == 0) {
+    info.channels = p[11];
+    info.sampleRate = readLE32(p + 12);
+  } else if (memcmp(p, "OpusHead", 8) == 0) {
+    // Opus granules always count 48 kHz samples.
+    info.channels = p[9];
+    info.sampleRate = 48000;
+    preSkip = readLE16(p + 10);
+  } else if (memcmp(p, "\x7F" "FLAC", 5) == 0 && packet + 17 + 34 <= headSize) {
+    AudioProbeInfo streamInfo;
+    if (!parseStreamInfo(p + 17, streamInfo))
+      return false;
+    info.channels = streamInfo.channels;
+    info.sampleRate = streamInfo.sampleRate;
+  } else {
+    return false;
+  }
+  if (info.sampleRate == 0)
+    return false;
+
+  // The last page of the stream carries the total in its granule position.
+  for (size_t i = tailSize >= 27 ? tailSize - 27 : 0; tailSize >= 27; --i) {
+    const unsigned char *page = tail + i;
+    if (memcmp(page, "OggS", 4) == 0 && page[4] == 0 &&
+        readLE32(page + 14) == serial) {
+      uint64_t granule = readLE64(page + 6);
+      if (granule != ~0ull) {
+        info.lengthFrames = granule > preSkip ? granule - preSkip : 0;
+        return true;
+      }
+    }
+    if (i == 0)
+      break;
+  }
+  return false;
+}
+
+AudioFormat sniffFormat(const unsigned char *data, size_t size,
+                        bool afterTag) {
+  size = std::min(size, SNIFF_BYTES);
+  if (size >= 12 &&
+      (memcmp(data, "RIFF", 4) == 0 || memcmp(data, "RF64", 4) == 0) &&
+      memcmp(data + 8, "WAVE", 4) == 0)
+    return AUDIO_WAV;
+  if (size >= 4 && memcmp(data, "fLaC", 4) == 0)
+    return AUDIO_FLAC;
+  if (size >= 4 && memcmp(data, "OggS", 4) == 0) {
+    // The first page carries only the codec's identification packet.
+    size_t packet = size >= 27 ? 27 + data[26] : size;
+    if (packet + 7 <= size && memcmp(data + packet, "\x01vorbis", 7) == 0)
+      return AUDIO_VORBIS;
+    return AUDIO_UNKNOWN;
+  }
+  Mp3Frame frame;
+  for (size_t i = 0; i + 4 <= size; ++i) {
+    if (data[i] == 0xFF && parseMp3Header(data + i, frame))
+      return AUDIO_MP3;
+  }
+  // Padding after a tag can run on past what is looked at.
+  return afterTag ? AUDIO_MP3 : AUDIO_UNKNOWN;
+}
+
+bool probeBuffers(const unsigned char *head, size_t headSize,
+                  uint64_t headOffset, const unsigned char *tail,
+                  size_t tailSize, uint64_t fileSize, AudioProbeInfo &info) {
+  info = AudioProbeInfo();
+  info.format = sniffFormat(head, headSize, headOffset > 0);
+  bool ok;
+  if (info.format == AUDIO_WAV)
+    ok = probeWav(head, headSize, fileSize, info);
+  else if (headSize >= 4 && memcmp(head, "fLaC", 4) == 0)
+    ok = probeFlac(head, headSize, info);
+  else if (headSize >= 4 && memcmp(head, "OggS", 4) == 0)
+    ok = probeOgg(head, headSize, tail, tailSize, info);
+  else if ((ok = probeMp3(head, headSize, headOffset, tail, tailSize,
+                           fileSize, info)))
+    info.format = AUDIO_MP3; // Found past junk the sniff did not look at
+  info.ok = ok && info.channels > 0;
+  return info.ok;
+}
+
+bool probeFile(const std::string &path, AudioProbeInfo &info) {
+  info = AudioProbeInfo();
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return false;
+
+  struct stat st;
+  unsigned char head[PROBE_HEAD_BYTES];
+  unsigned char tail[PROBE_TAIL_BYTES];
+  ssize_t headSize = -1;
+  ssize_t tailSize = 0;
+  uint64_t headOffset = 0;
+  if (fstat(fd, &st) == 0)
+    headSize = pread(fd, head, sizeof(head), 0);
+
+  if (headSize > 0) {
+    // Skip embedded artwork and the rest of the ID3v2 tag in one seek.
+    size_t tagSize = id3v2TagSize(head, headSize);
+    if (tagSize > 0) {
+      headOffset = tagSize;
+      headSize = (uint64_t)st.st_size > tagSize
+                     ? pread(fd, head, sizeof(head), tagSize)
+                     : 0;
+    }
+  }
+
+  if (headSize > 0) {
+    // Only Ogg needs to look far back; MP3 just checks for an ID3v1 tag.
+    size_t want = headSize >= 4 && memcmp(head, "OggS", 4) == 0
+                      ? sizeof(tail)
+                      : 128;
+    want = std::min<uint64_t>(want, st.st_size);
+    tailSize = pread(fd, tail, want, st.st_size - want);
+  }
+  close(fd);
+
+  if (headSize <= 0 || tailSize < 0)
+    return false;
+  return probeBuffers(head, headSize, headOffset, tail, tailSize, st.st_size,
+                      info);
+}
+
+std::vector<AudioProbeInfo> probeFiles(const std::vector<std::string> &paths,
+                                       unsigned threads) {
+  std::vector<AudioProbeInfo> results(paths.size());
+  if (threads == 0)
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  threads = std::min<size_t>(threads, paths.size());
+
+  // Each probe is a handful of small preads, so a shared cursor balances
+  // the work well enough.
+  std::atomic<size_t> next(0);
+  auto worker = [&]() {
+    for (size_t i; (i = next.fetch_add(1)) < paths.size();)
+      probeFile(paths[i], results[i]);
+  };
+  std::vector<std::thread> pool;
+  for (unsigned t = 1; t < threads; ++t)
+    pool.emplace_back(worker);
+  if (threads > 0)
+    worker();
+  for (auto &thread : pool)
+    thread.join();
+  return results;
+}
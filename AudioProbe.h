@@ -0,0 +1,65 @@
+#ifndef AUDIO_PROBE_H
+#define AUDIO_PROBE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// What the first bytes of the audio data say it is. Only formats one of
+// the decoders accepts are recognised.
+enum AudioFormat {
+  AUDIO_UNKNOWN,
+  AUDIO_WAV,
+  AUDIO_FLAC,
+  AUDIO_MP3,
+  AUDIO_VORBIS // Ogg Vorbis; Opus and Ogg FLAC are AUDIO_UNKNOWN
+};
+
+// Duration and format read from a file's headers, without decoding.
+struct AudioProbeInfo {
+  bool ok = false;
+  // Set from the magic bytes even when the rest of the headers are bad.
+  AudioFormat format = AUDIO_UNKNOWN;
+  // Set when no header carried an exact length (CBR MP3 without a Xing
+  // frame, truncated WAV, ...) and it was computed from the file size.
+  bool estimated = false;
+  uint64_t lengthFrames = 0;
+  uint32_t sampleRate = 0;
+  uint32_t channels = 0;
+
+  double seconds() const {
+    return sampleRate ? (double)lengthFrames / sampleRate : 0.0;
+  }
+};
+
+// Bytes read from the start of a file (after any ID3v2 tag) and from its
+// end. Enough for every header this probe understands.
+const size_t PROBE_HEAD_BYTES = 4096;
+const size_t PROBE_TAIL_BYTES = 16384;
+
+// Bytes sniffFormat() looks at.
+const size_t SNIFF_BYTES = 64;
+
+// Size of an ID3v2 tag at the start of data, or 0 if there is none.
+size_t id3v2TagSize(const unsigned char *data, size_t size);
+
+// Identifies the audio data by its first SNIFF_BYTES. data starts past any
+// ID3v2 tag; afterTag says there was one, which makes MP3 the fallback.
+AudioFormat sniffFormat(const unsigned char *data, size_t size, bool afterTag);
+
+// Parses already-read bytes. head holds the file from headOffset on (past
+// the ID3v2 tag), tail holds its last tailSize bytes.
+bool probeBuffers(const unsigned char *head, size_t headSize,
+                  uint64_t headOffset, const unsigned char *tail,
+                  size_t tailSize, uint64_t fileSize, AudioProbeInfo &info);
+
+// Reads at most a few KB of path and parses them.
+bool probeFile(const std::string &path, AudioProbeInfo &info);
+
+// Probes every path on a pool of threads (0 = one per core). The result is
+// indexed like paths; failed probes have ok == false.
+std::vector<AudioProbeInfo> probeFiles(const std::vector<std::string> &paths,
+                                       unsigned threads = 0);
+
+#endif // AUDIO_PROBE_H
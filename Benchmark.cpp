@@ -0,0 +1,298 @@
+// Pipeline benchmark. Drives TermMusicPlayer without a sound card and prints
+// one JSON document to stdout:
+//
+//   ./music_player_bench [fixture ...]
+//
+// With no arguments it benchmarks a generated sweep and the bundled
+// "18. Horizon.mp3".
+#include "FftUtils.h"
+#include "MusicPlayer.h"
+#include "RtGuard.h"
+#include "VisualizerNode.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+using Clock = std::chrono::steady_clock;
+
+static double secondsSince(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+static std::string jsonString(const std::string &s) {
+  std::string out = "\"";
+  for (char c : s) {
+    if (c == '"' || c == '\\') {
+      out += '\\';
+      out += c;
+    } else if ((unsigned char)c < 0x20) {
+      char esc[8];
+      snprintf(esc, sizeof(esc), "\\u%04x", c);
+      out += esc;
+    } else {
+      out += c;
+    }
+  }
+  return out + "\"";
+}
+
+// Stereo log sweep with a little noise so every bar of the visualizer moves
+static bool writeSweep(const std::string &path, float seconds) {
+  const ma_uint32 sampleRate = 44100;
+  const ma_uint32 channels = 2;
+  ma_encoder_config config = ma_encoder_config_init(
+      ma_encoding_format_wav, ma_format_f32, channels, sampleRate);
+  ma_encoder encoder;
+  if (ma_encoder_init_file(path.c_str(), &config, &encoder) != MA_SUCCESS)
+    return false;
+
+  const ma_uint64 totalFrames = (ma_uint64)(seconds * sampleRate);
+  std::vector<float> frames(totalFrames * channels);
+  double phase = 0.0;
+  ma_uint32 noise = 0x12345678;
+  for (ma_uint64 i = 0; i < totalFrames; ++i) {
+    double t = (double)i / totalFrames;
+    double freq = 20.0 * std::pow(1000.0, t); // 20 Hz -> 20 kHz
+    phase += 2.0 * PI * freq / sampleRate;
+    noise = noise * 1664525u + 1013904223u;
+    float n = ((noise >> 9) / (float)(1 << 23) - 0.5f) * 0.05f;
+    float sample = 0.5f * (float)std::sin(phase) + n;
+    frames[i * channels] = sample;
+    frames[i * channels + 1] = sample;
+  }
+  ma_encoder_write_pcm_frames(&encoder, frames.data(), totalFrames, NULL);
+  ma_encoder_uninit(&encoder);
+  return true;
+}
+
+struct Percentiles {
+  double mean = 0, p50 = 0, p99 = 0, max = 0;
+};
+
+static Percentiles summarize(std::vector<double> &samples) {
+  Percentiles p;
+  if (samples.empty())
+    return p;
+  std::sort(samples.begin(), samples.end());
+  double sum = 0;
+  for (double s : samples)
+    sum += s;
+  p.mean = sum / samples.size();
+  p.p50 = samples[samples.size() / 2];
+  p.p99 = samples[std::min(samples.size() - 1, samples.size() * 99 / 100)];
+  p.max = samples.back();
+  return p;
+}
+
+static void benchDecode(const std::string &path) {
+  ma_decoder_config config = ma_decoder_config_init(ma_format_f32, 0, 0);
+  ma_decoder decoder;
+  auto start = Clock::now();
+  if (ma_decoder_init_file(path.c_str(), &config, &decoder) != MA_SUCCESS) {
+    printf("\"decode\": null");
+    return;
+  }
+  ma_uint32 channels, sampleRate;
+  ma_decoder_get_data_format(&decoder, NULL, &channels, &sampleRate, NULL, 0);
+
+  std::vector<float> chunk(4096 * channels);
+  ma_uint64 total = 0, read = 0;
+  while (ma_decoder_read_pcm_frames(&decoder, chunk.data(), 4096, &read) ==
+             MA_SUCCESS &&
+         read > 0)
+    total += read;
+  double elapsed = secondsSince(start);
+  ma_decoder_uninit(&decoder);
+
+  std::error_code error;
+  double inputMB = fs::file_size(path, error) / 1e6;
+  if (error)
+    inputMB = 0.0;
+  double pcmMB = total * channels * sizeof(float) / 1e6;
+  double audioSeconds = (double)total / sampleRate;
+  printf("\"decode\": {\"frames\": %llu, \"seconds\": %.6f, "
+         "\"input_mb_per_s\": %.3f, \"pcm_mb_per_s\": %.3f, "
+         "\"x_realtime\": %.2f}",
+         (unsigned long long)total, elapsed, inputMB / elapsed,
+         pcmMB / elapsed, audioSeconds / elapsed);
+}
+
+// One readFrames() call is exactly what the device callback does
+static void benchGraph(const std::string &path, ma_uint32 periodFrames) {
+  AudioConfig config;
+  config.noDevice = true;
+  config.periodSizeInFrames = periodFrames;
+  TermMusicPlayer player(config);
+
+  auto loadStart = Clock::now();
+  if (!player.isInit() || !player.play(path)) {
+    printf("\"graph\": null");
+    return;
+  }
+  double loadSeconds = secondsSince(loadStart);
+
+  ma_uint32 channels = player.getChannels();
+  std::vector<float> out(periodFrames * channels);
+  std::vector<double> costs;
+  ma_uint64 frames = 0;
+  const ma_uint64 totalFrames = player.getLengthInFrames();
+  auto start = Clock::now();
+  while (!player.isAtEnd() && frames < totalFrames) {
+    auto t0 = Clock::now();
+    frames += player.readFrames(out.data(), periodFrames);
+    costs.push_back(std::chrono::duration<double, std::micro>(Clock::now() - t0)
+                        .count());
+  }
+  double elapsed = secondsSince(start);
+  double budgetUs = 1e6 * periodFrames / player.getSampleRate();
+  Percentiles p = summarize(costs);
+  AllocStats mem = player.getAllocStats();
+  printf("\"memory\": {\"track_bytes\": %llu, \"track_allocs\": %llu, "
+         "\"engine_bytes\": %llu, \"pooled_bytes\": %llu},\n     ",
+         (unsigned long long)mem.category[ALLOC_TRACK].liveBytes,
+         (unsigned long long)mem.trackAllocs,
+         (unsigned long long)mem.category[ALLOC_ENGINE].liveBytes,
+         (unsigned long long)mem.pooledBytes);
+  printf("\"graph\": {\"load_ms\": %.3f, \"period_frames\": %u, "
+         "\"callbacks\": %zu, \"budget_us\": %.1f, \"mean_us\": %.3f, "
+         "\"p50_us\": %.3f, \"p99_us\": %.3f, \"max_us\": %.3f, "
+         "\"x_realtime\": %.2f}",
+         loadSeconds * 1e3, periodFrames, costs.size(), budgetUs, p.mean,
+         p.p50, p.p99, p.max,
+         elapsed > 0 ? (double)frames / player.getSampleRate() / elapsed : 0.0);
+}
+
+static void benchNullBackend(const std::string &path, double seconds) {
+  AudioConfig config;
+  config.nullBackend = true;
+  TermMusicPlayer player(config);
+  if (!player.isInit() || !player.play(path)) {
+    printf("\"null_backend\": null");
+    return;
+  }
+  std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+  CallbackStats stats = player.getCallbackStats();
+  printf("\"null_backend\": {\"seconds\": %.2f, \"period_frames\": %u, "
+         "\"periods\": %u, \"callbacks\": %llu, \"mean_us\": %.3f, "
+         "\"max_us\": %.3f}",
+         seconds, player.getPeriodSizeInFrames(), player.getPeriods(),
+         (unsigned long long)stats.callbacks,
+         stats.callbacks ? stats.totalNs / 1e3 / stats.callbacks : 0.0,
+         stats.maxNs / 1e3);
+}
+
+static CArray makeWindowedBlock() {
+  CArray data(FFT_SIZE);
+  for (int j = 0; j < FFT_SIZE; ++j) {
+    float window = 0.5f * (1.0f - cos(2.0f * PI * j / (FFT_SIZE - 1)));
+    float sample = std::sin(2.0f * PI * 440.0f * j / 44100.0f);
+    data[j] = Complex(sample * window, 0);
+  }
+  return data;
+}
+
+static void benchFft(int iterations) {
+  const CArray block = makeWindowedBlock();
+  std::vector<double> costs;
+  costs.reserve(iterations);
+  for (int i = 0; i < iterations; ++i) {
+    CArray data = block;
+    auto t0 = Clock::now();
+    fft(data);
+    costs.push_back(std::chrono::duration<double, std::micro>(Clock::now() - t0)
+                        .count());
+  }
+  Percentiles p = summarize(costs);
+  printf("\"fft\": {\"size\": %d, \"iterations\": %d, \"mean_us\": %.3f, "
+         "\"p50_us\": %.3f, \"p99_us\": %.3f}",
+         FFT_SIZE, iterations, p.mean, p.p50, p.p99);
+}
+
+static void benchBars(int iterations) {
+  CArray spectrum = makeWindowedBlock();
+  fft(spectrum);
+  float bars[NUM_BARS];
+  float sink = 0.0f;
+  auto start = Clock::now();
+  for (int i = 0; i < iterations; ++i) {
+    mapSpectrumToBars(&spectrum[0], bars);
+    sink += bars[i % NUM_BARS];
+  }
+  double elapsed = secondsSince(start);
+  printf("\"bars\": {\"bars\": %d, \"iterations\": %d, \"mean_ns\": %.1f, "
+         "\"checksum\": %.3f}",
+         NUM_BARS, iterations, elapsed * 1e9 / iterations, sink);
+}
+
+int main(int argc, char **argv) {
+  std::vector<std::string> fixtures;
+  std::string sweepPath =
+      (fs::temp_directory_path() / "musical_bench_sweep.wav").string();
+  if (argc > 1) {
+    for (int i = 1; i < argc; ++i)
+      fixtures.push_back(argv[i]);
+  } else {
+    if (writeSweep(sweepPath, 30.0f))
+      fixtures.push_back(sweepPath);
+    if (fs::exists("18. Horizon.mp3"))
+      fixtures.push_back("18. Horizon.mp3");
+  }
+
+  printf("{\n  \"miniaudio\": \"%s\",\n  \"fixtures\": [", MA_VERSION_STRING);
+  for (size_t i = 0; i < fixtures.size(); ++i) {
+    const std::string &path = fixtures[i];
+    // A missing or unreadable fixture gets nulls; the document stays valid
+    std::error_code error;
+    uintmax_t bytes = fs::file_size(path, error);
+    printf("%s\n    {\"path\": %s, \"bytes\": ", i ? "," : "",
+           jsonString(path).c_str());
+    if (error) {
+      printf("null,\n     \"decode\": null,\n     \"graph\": null}");
+      fflush(stdout);
+      continue;
+    }
+    printf("%llu,\n     ", (unsigned long long)bytes);
+    benchDecode(path);
+    printf(",\n     ");
+    benchGraph(path, 512);
+    printf("}");
+    fflush(stdout);
+  }
+  printf("\n  ],\n  ");
+  benchFft(2000);
+  printf(",\n  ");
+  benchBars(100000);
+  printf(",\n  ");
+  if (!fixtures.empty())
+    benchNullBackend(fixtures.front(), 1.0);
+  else
+    printf("\"null_backend\": null");
+#ifdef RT_GUARD
+  printf(",\n  \"rt_guard\": {\"violations\": %llu",
+         rtGuardViolationCount());
+  for (int k = 0; k < RT_KIND_COUNT; ++k)
+    printf(", \"%s\": %llu", rtGuardKindName((RtViolationKind)k),
+           rtGuardViolationCount((RtViolationKind)k));
+  printf("}");
+#endif
+  printf("\n}\n");
+
+  if (argc <= 1)
+    fs::remove(sweepPath);
+
+#ifdef RT_GUARD
+  // make rtcheck fails on any heap or blocking call from the audio path
+  if (rtGuardViolationCount() > 0) {
+    rtGuardDump(stderr);
+    return 2;
+  }
+#endif
+  return 0;
+}
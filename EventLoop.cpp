@@ -0,0 +1,220 @@
+#include "EventLoop.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#endif
+
+void notifyWakeFd(int fd) {
+  if (fd < 0)
+    return;
+  // A full pipe or a saturated eventfd already means a wakeup is pending.
+  uint64_t one = 1;
+  ssize_t ignored = write(fd, &one, sizeof(one));
+  (void)ignored;
+}
+
+#ifdef __linux__
+
+// epoll data tags, one per source.
+enum { SOURCE_INPUT, SOURCE_SIGNAL, SOURCE_TIMER, SOURCE_WAKE };
+
+static void blockedSignals(sigset_t &mask) {
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGWINCH);
+  sigaddset(&mask, SIGTERM);
+  // Raw mode keeps ISIG, so Ctrl-C arrives here and quits like SIGTERM,
+  // restoring the terminal on the way out.
+  sigaddset(&mask, SIGINT);
+}
+
+static bool watch(int pollFd, int fd, uint32_t source) {
+  struct epoll_event event = {};
+  event.events = EPOLLIN;
+  event.data.u32 = source;
+  return epoll_ctl(pollFd, EPOLL_CTL_ADD, fd, &event) == 0;
+}
+
+EventLoop::EventLoop() {
+  sigset_t mask;
+  blockedSignals(mask);
+  pthread_sigmask(SIG_BLOCK, &mask, nullptr);
+
+  pollFd = epoll_create1(EPOLL_CLOEXEC);
+  signalFd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+  timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  wakeFds[0] = wakeFds[1] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  // epoll refuses regular files; those are always readable anyway.
+  inputAlwaysReady = !watch(pollFd, STDIN_FILENO, SOURCE_INPUT) &&
+                     errno == EPERM;
+  watch(pollFd, signalFd, SOURCE_SIGNAL);
+  watch(pollFd, timerFd, SOURCE_TIMER);
+  watch(pollFd, wakeFds[0], SOURCE_WAKE);
+}
+
+EventLoop::~EventLoop() {
+  for (int fd : {pollFd, signalFd, timerFd, wakeFds[0]})
+    if (fd >= 0)
+      close(fd);
+  sigset_t mask;
+  blockedSignals(mask);
+  pthread_sigmask(SIG_UNBLOCK, &mask, nullptr);
+}
+
+void EventLoop::setTick(int intervalMs) {
+  if (intervalMs == tickMs)
+    return;
+  tickMs = intervalMs;
+  struct itimerspec spec = {};
+  spec.it_interval.tv_sec = intervalMs / 1000;
+  spec.it_interval.tv_nsec = (intervalMs % 1000) * 1000000L;
+  spec.it_value = spec.it_interval;
+  timerfd_settime(timerFd, 0, &spec, nullptr);
+}
+
+void EventLoop::closeInput() {
+  epoll_ctl(pollFd, EPOLL_CTL_DEL, STDIN_FILENO, nullptr);
+  inputAlwaysReady = false;
+}
+
+unsigned EventLoop::wait(int timeoutMs) {
+  struct epoll_event ready[4];
+  int count = epoll_wait(pollFd, ready, 4, inputAlwaysReady ? 0 : timeoutMs);
+  unsigned events = inputAlwaysReady ? EVENT_INPUT : 0;
+  for (int i = 0; i < count; ++i) {
+    switch (ready[i].data.u32) {
+    case SOURCE_INPUT:
+      events |= EVENT_INPUT;
+      break;
+    case SOURCE_SIGNAL: {
+      struct signalfd_siginfo info;
+      while (read(signalFd, &info, sizeof(info)) == sizeof(info))
+        events |= info.ssi_signo == SIGWINCH ? EVENT_RESIZE : EVENT_QUIT;
+      break;
+    }
+    case SOURCE_TIMER: {
+      uint64_t expirations;
+      if (read(timerFd, &expirations, sizeof(expirations)) > 0)
+        events |= EVENT_TICK;
+      break;
+    }
+    case SOURCE_WAKE: {
+      uint64_t wakeups;
+      if (read(wakeFds[0], &wakeups, sizeof(wakeups)) > 0)
+        events |= EVENT_WAKE;
+      break;
+    }
+    }
+  }
+  return events;
+}
+
+#else
+
+// The signal handlers only know this pipe; the byte tells them apart from
+// the 8-byte counts written by notifyWakeFd().
+static int signalWriteFd = -1;
+
+static void forwardSignal(int sig) {
+  int saved = errno;
+  char byte = sig == SIGWINCH ? 'r' : 'q';
+  ssize_t ignored = write(signalWriteFd, &byte, 1);
+  (void)ignored;
+  errno = saved;
+}
+
+static long long nowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+EventLoop::EventLoop() {
+  if (pipe(wakeFds) == 0) {
+    for (int fd : wakeFds) {
+      fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+      fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+  }
+  signalWriteFd = wakeFds[1];
+  struct sigaction action = {};
+  action.sa_handler = forwardSignal;
+  sigemptyset(&action.sa_mask);
+  action.sa_flags = SA_RESTART;
+  sigaction(SIGWINCH, &action, nullptr);
+  sigaction(SIGTERM, &action, nullptr);
+  sigaction(SIGINT, &action, nullptr);
+}
+
+EventLoop::~EventLoop() {
+  signal(SIGWINCH, SIG_DFL);
+  signal(SIGTERM, SIG_DFL);
+  signal(SIGINT, SIG_DFL);
+  signalWriteFd = -1;
+  for (int fd : wakeFds)
+    if (fd >= 0)
+      close(fd);
+}
+
+void EventLoop::setTick(int intervalMs) {
+  if (intervalMs == tickMs)
+    return;
+  tickMs = intervalMs;
+  nextTickNs = nowNs() + intervalMs * 1000000LL;
+}
+
+void EventLoop::closeInput() { inputClosed = true; }
+
+unsigned EventLoop::wait(int timeoutMs) {
+  int timeout = timeoutMs;
+  if (tickMs > 0) {
+    long long untilTick = (nextTickNs - nowNs() + 999999) / 1000000;
+    int tickTimeout = (int)(untilTick > 0 ? untilTick : 0);
+    timeout = timeout < 0 ? tickTimeout : std::min(timeout, tickTimeout);
+  }
+
+  struct pollfd fds[2] = {{inputClosed ? -1 : STDIN_FILENO, POLLIN, 0},
+                          {wakeFds[0], POLLIN, 0}};
+  unsigned events = 0;
+  if (poll(fds, 2, timeout) > 0) {
+    if (fds[0].revents)
+      events |= EVENT_INPUT;
+    if (fds[1].revents & POLLIN) {
+      char drain[64];
+      ssize_t bytes;
+      while ((bytes = read(wakeFds[0], drain, sizeof(drain))) > 0) {
+        for (ssize_t i = 0; i < bytes; ++i) {
+          if (drain[i] == 'r')
+            events |= EVENT_RESIZE;
+          else if (drain[i] == 'q')
+            events |= EVENT_QUIT;
+          else
+            events |= EVENT_WAKE;
+        }
+      }
+    }
+  }
+  if (tickMs > 0) {
+    long long now = nowNs();
+    if (now >= nextTickNs) {
+      events |= EVENT_TICK;
+      // Missed ticks are dropped rather than delivered in a burst.
+      nextTickNs += tickMs * 1000000LL;
+      if (nextTickNs <= now)
+        nextTickNs = now + tickMs * 1000000LL;
+    }
+  }
+  return events;
+}
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+// Bits returned by EventLoop::wait().
+enum LoopEvent {
+  EVENT_INPUT = 1,  // stdin is readable
+  EVENT_RESIZE = 2, // SIGWINCH
+  EVENT_QUIT = 4,   // SIGTERM or SIGINT
+  EVENT_TICK = 8,   // A frame tick is due
+  EVENT_WAKE = 16   // Another thread wrote to getWakeFd()
+};
+
+// Blocks the UI thread until there is something to do. On Linux it sleeps
+// in epoll_wait on stdin, a signalfd for SIGWINCH, SIGTERM and SIGINT, a
+// timerfd for frame ticks and an eventfd other threads post to. Elsewhere
+// it uses poll() on stdin and a self-pipe that both the signal handlers and
+// other threads write to, with ticks kept as a poll timeout.
+class EventLoop {
+public:
+  // Blocks SIGWINCH, SIGTERM and SIGINT in the calling thread so they are
+  // only seen through the signalfd. Threads inherit the mask, so construct
+  // the loop before any thread is started.
+  EventLoop();
+  ~EventLoop();
+  EventLoop(const EventLoop &) = delete;
+  EventLoop &operator=(const EventLoop &) = delete;
+
+  // Other threads wake the loop by writing an 8-byte count here; see
+  // notifyWakeFd().
+  int getWakeFd() const { return wakeFds[1]; }
+  // Delivers EVENT_TICK every intervalMs; 0 stops the ticks.
+  void setTick(int intervalMs);
+  // Stops watching stdin, once it has reached end of file.
+  void closeInput();
+  // Waits for at least one event, or until timeoutMs passes (-1 waits
+  // forever), and returns the LoopEvent bits that fired. Signals, ticks
+  // and wakeups are consumed; pending input is left for the caller.
+  unsigned wait(int timeoutMs = -1);
+
+private:
+  int pollFd = -1;               // epoll instance (Linux)
+  int signalFd = -1;             // SIGWINCH, SIGTERM, SIGINT (Linux)
+  int timerFd = -1;              // Frame ticks (Linux)
+  int wakeFds[2] = {-1, -1};     // eventfd in both slots, or a self-pipe
+  int tickMs = 0;
+  bool inputAlwaysReady = false; // stdin is a regular file (Linux)
+  bool inputClosed = false;      // poll() fallback only
+  long long nextTickNs = 0;      // poll() fallback only
+};
+
+// Writes a wakeup to fd, as returned by EventLoop::getWakeFd(); a negative
+// fd is ignored. Safe from any thread and never blocks.
+void notifyWakeFd(int fd);
+
+#endif // EVENT_LOOP_H
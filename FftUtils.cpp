@@ -1,22 +1,36 @@
 #include "FftUtils.h"
+#include <utility>
 
-void fft(CArray &x) {
-  const size_t N = x.size();
-  if (N <= 1)
+void fft(Complex *x, size_t n) {
+  if (n <= 1)
     return;
 
-  // Divide
-  CArray even = x[std::slice(0, N / 2, 2)];
-  CArray odd = x[std::slice(1, N / 2, 2)];
-
-  // Conquer
-  fft(even);
-  fft(odd);
+  // Bit-reversal permutation
+  for (size_t i = 1, j = 0; i < n; ++i) {
+    size_t bit = n >> 1;
+    for (; j & bit; bit >>= 1)
+      j ^= bit;
+    j ^= bit;
+    if (i < j)
+      std::swap(x[i], x[j]);
+  }
 
-  // Combine
-  for (size_t k = 0; k < N / 2; ++k) {
-    Complex t = std::polar(1.0f, -2 * PI * k / N) * odd[k];
-    x[k] = even[k] + t;
-    x[k + N / 2] = even[k] - t;
+  // Butterflies, doubling the transform length each pass
+  for (size_t len = 2; len <= n; len <<= 1) {
+    Complex wLen = std::polar(1.0f, -2 * PI / len);
+    for (size_t start = 0; start < n; start += len) {
+      Complex w(1.0f, 0.0f);
+      for (size_t k = 0; k < len / 2; ++k) {
+        Complex t = w * x[start + k + len / 2];
+        x[start + k + len / 2] = x[start + k] - t;
+        x[start + k] += t;
+        w *= wLen;
+      }
+    }
   }
 }
+
+void fft(CArray &x) {
+  if (x.size() > 0)
+    fft(&x[0], x.size());
+}
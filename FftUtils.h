@@ -2,6 +2,7 @@
 #define FFT_UTILS_H
 
 #include <complex>
+#include <cstddef>
 #include <valarray>
 
 using Complex = std::complex<float>;
@@ -9,6 +10,9 @@ using CArray = std::valarray<Complex>;
 
 const float PI = 3.141592653589793238460f;
 
+// In-place iterative radix-2 FFT. n must be a power of two. Does not
+// allocate, so it is safe to call from the audio thread.
+void fft(Complex *x, size_t n);
 void fft(CArray &x);
 
 #endif // FFT_UTILS_H
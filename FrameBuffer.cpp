@@ -0,0 +1,72 @@
+#include "FrameBuffer.h"
+#include <cerrno>
+#include <cstdarg>
+#include <cstdio>
+#include <unistd.h>
+
+FrameBuffer::FrameBuffer(size_t capacity) : bytes(capacity) {}
+
+void FrameBuffer::grow(size_t extra) {
+  size_t size = bytes.size() ? bytes.size() : 256;
+  while (size - used < extra)
+    size *= 2;
+  bytes.resize(size);
+}
+
+void FrameBuffer::appendNumber(long value) {
+  char digits[24];
+  int count = 0;
+  unsigned long magnitude =
+      value < 0 ? 0ul - (unsigned long)value : (unsigned long)value;
+  do {
+    digits[count++] = (char)('0' + magnitude % 10);
+    magnitude /= 10;
+  } while (magnitude > 0);
+  if (value < 0)
+    append('-');
+  while (count > 0)
+    append(digits[--count]);
+}
+
+void FrameBuffer::repeat(const char *text, int count) {
+  size_t length = strlen(text);
+  if (count <= 0 || length == 0)
+    return;
+  if (bytes.size() - used < length * count)
+    grow(length * count);
+  for (int i = 0; i < count; ++i) {
+    memcpy(bytes.data() + used, text, length);
+    used += length;
+  }
+}
+
+void FrameBuffer::appendf(const char *format, ...) {
+  va_list args;
+  va_start(args, format);
+  va_list retry;
+  va_copy(retry, args);
+  size_t room = bytes.size() - used;
+  int length = vsnprintf(bytes.data() + used, room, format, args);
+  va_end(args);
+  if (length >= 0 && (size_t)length >= room) {
+    grow((size_t)length + 1);
+    vsnprintf(bytes.data() + used, bytes.size() - used, format, retry);
+  }
+  va_end(retry);
+  if (length > 0)
+    used += length;
+}
+
+bool FrameBuffer::writeTo(int fd) const {
+  size_t done = 0;
+  while (done < used) {
+    ssize_t written = write(fd, bytes.data() + done, used - done);
+    if (written < 0) {
+      if (errno == EINTR || errno == EAGAIN)
+        continue;
+      return false;
+    }
+    done += written;
+  }
+  return true;
+}
@@ -0,0 +1,52 @@
+#ifndef FRAME_BUFFER_H
+#define FRAME_BUFFER_H
+
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Append-only byte buffer for one frame of terminal output. Its storage is
+// reserved up front and kept across clear(), so once it has grown to the
+// largest frame, building a frame allocates nothing.
+class FrameBuffer {
+public:
+  explicit FrameBuffer(size_t capacity = 64 * 1024);
+
+  void clear() { used = 0; }
+  void append(char c) {
+    if (used == bytes.size())
+      grow(1);
+    bytes[used++] = c;
+  }
+  void append(const char *data, size_t size) {
+    if (bytes.size() - used < size)
+      grow(size);
+    memcpy(bytes.data() + used, data, size);
+    used += size;
+  }
+  void append(const char *text) { append(text, strlen(text)); }
+  void append(const std::string &text) { append(text.data(), text.size()); }
+  void appendNumber(long value);
+  // count copies of text.
+  void repeat(const char *text, int count);
+  // printf straight into the buffer.
+  void appendf(const char *format, ...)
+      __attribute__((format(printf, 2, 3)));
+
+  const char *data() const { return bytes.data(); }
+  size_t size() const { return used; }
+  bool empty() const { return used == 0; }
+
+  // Writes the contents to fd in one write() unless it is interrupted or
+  // only partly accepted. Returns false on an error.
+  bool writeTo(int fd) const;
+
+private:
+  void grow(size_t extra);
+
+  std::vector<char> bytes;
+  size_t used = 0;
+};
+
+#endif // FRAME_BUFFER_H
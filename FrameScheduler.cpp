@@ -0,0 +1,31 @@
+#include "FrameScheduler.h"
+#include <algorithm>
+
+// Scan counters are text; a few updates a second are plenty.
+static const int SCAN_TICK_MS = 100;
+// Another window has focus; the player may still be on screen next to it.
+static const int UNFOCUSED_TICK_MS = 200;
+
+FrameScheduler::FrameScheduler(int fps) : fps(std::max(fps, 1)) {}
+
+int FrameScheduler::tickMs(bool playing, bool scanning, bool visible,
+                           bool focused) const {
+  if (!visible)
+    return 0;
+  int ms = 0;
+  if (playing)
+    ms = std::max(1000 / fps, 1);
+  else if (scanning)
+    ms = SCAN_TICK_MS;
+  if (ms > 0 && !focused)
+    ms = std::max(ms, UNFOCUSED_TICK_MS);
+  return ms;
+}
+
+bool FrameScheduler::changed(const FrameInputs &inputs) const {
+  return inputs.barRows != last.barRows ||
+         inputs.cursorSecond != last.cursorSecond ||
+         inputs.progressCells != last.progressCells ||
+         inputs.volumePercent != last.volumePercent ||
+         inputs.scanCount != last.scanCount;
+}
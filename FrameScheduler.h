@@ -0,0 +1,50 @@
+#ifndef FRAME_SCHEDULER_H
+#define FRAME_SCHEDULER_H
+
+#include "VisualizerNode.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+const int DEFAULT_FPS = 30;
+
+// What the parts of the UI that move on their own are drawn from, reduced
+// to what actually shows: the second on the clock rather than the cursor,
+// bar heights in rows rather than magnitudes.
+struct FrameInputs {
+  uint32_t spectrumSequence = 0; // Bars are only re-read when this moves
+  std::array<uint16_t, NUM_BARS> barRows = {};
+  int cursorSecond = -1;
+  int progressCells = -1;
+  int volumePercent = -1;
+  size_t scanCount = 0; // Directories, files and tags read so far
+};
+
+// Paces redraws. While a track plays the event loop ticks at the target
+// frame rate, and a tick becomes a frame only if its inputs differ from
+// the last frame drawn, so quiet passages cost next to nothing. Keys,
+// resizes and player events still redraw at once. Paused, stopped or with
+// the terminal too small for the UI there are no ticks at all. An
+// unfocused terminal may still be in view, so it keeps ticking, only at a
+// few frames a second.
+class FrameScheduler {
+public:
+  explicit FrameScheduler(int fps = DEFAULT_FPS);
+
+  int getFps() const { return fps; }
+  // Interval for EventLoop::setTick(): the frame interval while playing,
+  // a slow refresh while only the scan counters move, otherwise 0. Both
+  // slow down while the terminal is unfocused.
+  int tickMs(bool playing, bool scanning, bool visible, bool focused) const;
+  // Whether a tick with these inputs would draw anything new.
+  bool changed(const FrameInputs &inputs) const;
+  // Records the inputs of the frame just drawn.
+  void drawn(const FrameInputs &inputs) { last = inputs; }
+  const FrameInputs &getLast() const { return last; }
+
+private:
+  int fps;
+  FrameInputs last;
+};
+
+#endif // FRAME_SCHEDULER_H
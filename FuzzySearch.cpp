@@ -0,0 +1,279 @@
+#include "FuzzySearch.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+const size_t FuzzySearch::MAX_RESULTS;
+
+// Below this many candidates a search stays on the calling thread.
+static const size_t PARALLEL_THRESHOLD = 32768;
+
+// Bit of a (lowercased) byte in an entry's byte set. Letters and digits
+// get their own bits; everything else shares the remaining 28.
+static inline uint64_t byteBit(unsigned char c) {
+  if (c >= 'a' && c <= 'z')
+    return 1ull << (c - 'a');
+  if (c >= '0' && c <= '9')
+    return 1ull << (26 + c - '0');
+  return 1ull << (36 + c % 28);
+}
+
+static inline char toLower(char c) {
+  return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+}
+
+static bool isBoundary(char c) {
+  return c == '/' || c == ' ' || c == '-' || c == '_' || c == '.' ||
+         c == '(' || c == '[';
+}
+
+// Greedy leftmost subsequence match. Consecutive characters and matches at
+// word starts score high, gaps cost a little. -1 if query is not a
+// subsequence of haystack.
+static int matchScore(const char *haystack, size_t length,
+                      const std::string &query) {
+  int total = 0;
+  size_t pos = 0;
+  size_t prev = 0;
+  bool first = true;
+  for (char c : query) {
+    const char *hit = (const char *)memchr(haystack + pos, c, length - pos);
+    if (!hit)
+      return -1;
+    size_t index = hit - haystack;
+    if (!first && index == prev + 1) {
+      total += 8;
+    } else {
+      total += (index == 0 || isBoundary(haystack[index - 1])) ? 6 : 1;
+      if (!first)
+        total -= (int)std::min<size_t>(index - pos, 12) / 3;
+    }
+    first = false;
+    prev = index;
+    pos = index + 1;
+  }
+  // Shorter paths win ties.
+  return total * 4 - (int)(length / 32);
+}
+
+void FuzzySearch::sync(const TrackList &tracks) {
+  tagSource = &tracks;
+  if (tracks.getVersion() == syncedVersion)
+    return;
+  syncedVersion = tracks.getVersion();
+  text.clear();
+  entries.clear();
+  masks.clear();
+  entries.reserve(tracks.size());
+  masks.reserve(tracks.size());
+
+  std::string path;
+  for (size_t i = 0; i < tracks.size(); ++i) {
+    TrackId id = tracks.at(i);
+    path.clear();
+    tracks.getPaths().appendPath(id, path);
+    if (path.size() > 0xFFFF)
+      path.resize(0xFFFF);
+
+    Entry entry;
+    entry.text = (uint32_t)text.size();
+    entry.length = (uint16_t)path.size();
+    size_t slash = path.rfind('/');
+    entry.nameStart = slash == std::string::npos ? 0 : (uint16_t)(slash + 1);
+    entry.id = id;
+
+    uint64_t mask = 0;
+    for (char &c : path) {
+      c = toLower(c);
+      mask |= byteBit((unsigned char)c);
+    }
+    text += path;
+    entries.push_back(entry);
+    masks.push_back(mask);
+  }
+  reset();
+}
+
+void FuzzySearch::reset() {
+  haveLast = false;
+  lastQuery.clear();
+  candidates.clear();
+  matchCount = 0;
+  results.clear();
+}
+
+int FuzzySearch::score(const Entry &entry, const std::string &query) const {
+  const char *haystack = text.data() + entry.text;
+  // A match within the file name alone beats one spread over directories.
+  int nameScore = matchScore(haystack + entry.nameStart,
+                             entry.length - entry.nameStart, query);
+  if (nameScore >= 0)
+    return nameScore + 64;
+  return matchScore(haystack, entry.length, query);
+}
+
+// Worse-first heap order, so the root is the result to evict.
+static bool betterResult(const SearchResult &a, const SearchResult &b) {
+  return a.score > b.score;
+}
+
+// Scores entries [begin, end), or subset[begin, end) when narrowing.
+// Every match is appended to matched; only the best MAX_RESULTS are kept
+// in best, as a heap.
+void FuzzySearch::filter(const uint32_t *subset, size_t begin, size_t end,
+                         uint64_t queryMask, const std::string &query,
+                         std::vector<uint32_t> &matched,
+                         std::vector<SearchResult> &best) const {
+  auto check = [&](uint32_t index) {
+    int s = score(entries[index], query);
+    if (s < 0)
+      return;
+    matched.push_back(index);
+    if (best.size() < MAX_RESULTS || s > best.front().score) {
+      // Ties keep the earlier entry, since later ones never displace it.
+      if (best.size() == MAX_RESULTS) {
+        std::pop_heap(best.begin(), best.end(), betterResult);
+        best.pop_back();
+      }
+      SearchResult result = {index, s};
+      best.push_back(result);
+      std::push_heap(best.begin(), best.end(), betterResult);
+    }
+  };
+
+  if (subset) {
+    for (size_t i = begin; i < end; ++i) {
+      uint32_t index = subset[i];
+      if ((masks[index] & queryMask) == queryMask)
+        check(index);
+    }
+    return;
+  }
+
+  size_t i = begin;
+#ifdef __SSE2__
+  // Two byte sets per compare; an entry passes when both of its 32-bit
+  // halves still equal the query's after masking.
+  __m128i query128 = _mm_set1_epi64x((long long)queryMask);
+  for (; i + 2 <= end; i += 2) {
+    __m128i sets = _mm_loadu_si128((const __m128i *)(masks.data() + i));
+    __m128i equal =
+        _mm_cmpeq_epi32(_mm_and_si128(sets, query128), query128);
+    int bits = _mm_movemask_epi8(equal);
+    if (bits == 0)
+      continue;
+    if ((bits & 0x00FF) == 0x00FF)
+      check((uint32_t)i);
+    if ((bits & 0xFF00) == 0xFF00)
+      check((uint32_t)i + 1);
+  }
+#endif
+  for (; i < end; ++i) {
+    if ((masks[i] & queryMask) == queryMask)
+      check((uint32_t)i);
+  }
+}
+
+void FuzzySearch::search(const std::string &rawQuery) {
+  auto start = std::chrono::steady_clock::now();
+  std::string query;
+  uint64_t queryMask = 0;
+  for (char c : rawQuery) {
+    query += toLower(c);
+    queryMask |= byteBit((unsigned char)toLower(c));
+  }
+
+  if (TagIndex::isTagQuery(rawQuery)) {
+    // Tag matches are unranked; they are listed in id (discovery) order.
+    std::vector<TrackId> ids;
+    if (tagSource)
+      tagIndex.sync(*tagSource);
+    tagIndex.query(rawQuery, ids);
+    results.clear();
+    for (size_t i = 0; i < std::min(ids.size(), MAX_RESULTS); ++i) {
+      SearchResult result = {ids[i], 0};
+      results.push_back(result);
+    }
+    candidates.swap(ids);
+    matchCount = candidates.size();
+    // candidates now hold TrackIds, not entries, so never narrow from them.
+    haveLast = false;
+    lastSearchMs = std::chrono::duration<double, std::milli>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+    return;
+  }
+
+  bool narrow = haveLast && query.size() >= lastQuery.size() &&
+                query.compare(0, lastQuery.size(), lastQuery) == 0;
+  if (narrow && query == lastQuery)
+    return;
+
+  // Heap entries hold entry indices until they are turned into TrackIds.
+  std::vector<uint32_t> matched;
+  std::vector<SearchResult> best;
+  if (query.empty()) {
+    for (uint32_t i = 0; i < std::min(entries.size(), MAX_RESULTS); ++i) {
+      SearchResult result = {i, 0};
+      best.push_back(result);
+    }
+  } else {
+    const uint32_t *subset = narrow ? candidates.data() : nullptr;
+    size_t count = narrow ? candidates.size() : entries.size();
+    unsigned threads = 1;
+    if (count >= PARALLEL_THRESHOLD)
+      threads = (unsigned)std::min<size_t>(
+          std::max(1u, std::thread::hardware_concurrency()),
+          count / (PARALLEL_THRESHOLD / 2));
+
+    // Contiguous chunks, concatenated in order, keep matches in list order.
+    std::vector<std::vector<uint32_t>> chunkMatched(threads);
+    std::vector<std::vector<SearchResult>> chunkBest(threads);
+    auto run = [&](unsigned t) {
+      chunkMatched[t].reserve((count / threads) / 4);
+      filter(subset, count * t / threads, count * (t + 1) / threads,
+             queryMask, query, chunkMatched[t], chunkBest[t]);
+    };
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < threads; ++t)
+      pool.emplace_back(run, t);
+    run(0);
+    for (auto &thread : pool)
+      thread.join();
+
+    for (unsigned t = 0; t < threads; ++t) {
+      matched.insert(matched.end(), chunkMatched[t].begin(),
+                     chunkMatched[t].end());
+      best.insert(best.end(), chunkBest[t].begin(), chunkBest[t].end());
+    }
+  }
+
+  // Everything matches an empty query. Narrowing from it would walk every
+  // index without the SIMD prefilter, so the first key scans afresh.
+  candidates.swap(matched);
+  matchCount = query.empty() ? entries.size() : candidates.size();
+  lastQuery = query;
+  haveLast = !query.empty();
+
+  // Best score first, then list order.
+  std::sort(best.begin(), best.end(),
+            [](const SearchResult &a, const SearchResult &b) {
+              if (a.score != b.score)
+                return a.score > b.score;
+              return a.id < b.id;
+            });
+  if (best.size() > MAX_RESULTS)
+    best.resize(MAX_RESULTS);
+  for (auto &result : best)
+    result.id = entries[result.id].id;
+  results.swap(best);
+
+  lastSearchMs = std::chrono::duration<double, std::milli>(
+                     std::chrono::steady_clock::now() - start)
+                     .count();
+}
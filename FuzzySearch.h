@@ -0,0 +1,67 @@
+#ifndef FUZZY_SEARCH_H
+#define FUZZY_SEARCH_H
+
+#include "TagIndex.h"
+#include "TrackList.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct SearchResult {
+  TrackId id;
+  int score;
+};
+
+// Interactive subsequence search over the playlist's paths. Each entry
+// carries a 64-bit set of the (lowercased) bytes it contains; a query is
+// first checked against those sets, two entries per SSE2 compare, and
+// only survivors are scored. When a query extends the previous one the
+// search narrows the previous matches instead of starting over. Large
+// candidate sets are split across threads. Queries naming a tag field
+// ("artist:...") go to a TagIndex instead.
+class FuzzySearch {
+public:
+  // Most results kept sorted by score; the match count covers all.
+  static const size_t MAX_RESULTS = 100;
+
+  // Rebuilds the lowercased corpus if tracks changed since the last sync.
+  // The tag index only catches up when a tag query needs it.
+  void sync(const TrackList &tracks);
+  void search(const std::string &query);
+  // Forgets the previous query, so the next search scans everything.
+  void reset();
+
+  const std::vector<SearchResult> &getResults() const { return results; }
+  size_t getMatchCount() const { return matchCount; }
+  double getLastSearchMs() const { return lastSearchMs; }
+
+private:
+  struct Entry {
+    uint32_t text; // Offset into text
+    uint16_t length;
+    uint16_t nameStart; // Start of the file name within the entry
+    TrackId id;
+  };
+
+  int score(const Entry &entry, const std::string &query) const;
+  void filter(const uint32_t *subset, size_t begin, size_t end,
+              uint64_t queryMask, const std::string &query,
+              std::vector<uint32_t> &matched,
+              std::vector<SearchResult> &best) const;
+
+  std::string text;
+  std::vector<Entry> entries;
+  std::vector<uint64_t> masks; // Parallel to entries, contiguous for SIMD
+  uint64_t syncedVersion = ~0ull;
+  TagIndex tagIndex;
+  const TrackList *tagSource = nullptr;
+
+  std::string lastQuery;
+  bool haveLast = false;
+  std::vector<uint32_t> candidates; // Entries matching lastQuery, in order
+  size_t matchCount = 0;
+  std::vector<SearchResult> results;
+  double lastSearchMs = 0.0;
+};
+
+#endif // FUZZY_SEARCH_H
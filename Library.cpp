@@ -0,0 +1,474 @@
+#include "Library.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <random>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char LIBRARY_MAGIC[8] = {'M', 'U', 'S', 'L', 'I', 'B', 0, 0};
+static const uint32_t LIBRARY_VERSION = 4;
+static const char LIBRARY_LOG_MAGIC[8] = {'M', 'U', 'S', 'L', 'O', 'G', 0, 0};
+static const uint32_t LIBRARY_LOG_VERSION = 2;
+
+void fillTrackStat(TrackMeta &meta, const struct stat &st) {
+  meta.size = st.st_size;
+#ifdef __APPLE__
+  meta.mtimeNs =
+      (int64_t)st.st_mtimespec.tv_sec * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+  meta.mtimeNs = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+}
+
+Library::~Library() { close(); }
+
+bool Library::open(const std::string &path) {
+  close();
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return false;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(LibraryIndexHeader)) {
+    ::close(fd);
+    return false;
+  }
+  void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (data == MAP_FAILED)
+    return false;
+  mapping = data;
+  mappingSize = st.st_size;
+
+  // Only the header is checked here; record contents are bounds-checked
+  // when their strings are looked up.
+  const LibraryIndexHeader *h = (const LibraryIndexHeader *)data;
+  uint64_t count = h->count;
+  bool valid =
+      memcmp(h->magic, LIBRARY_MAGIC, sizeof(LIBRARY_MAGIC)) == 0 &&
+      h->version == LIBRARY_VERSION && h->fileSize == mappingSize &&
+      h->stringsSize > 0 && h->stringsOffset + h->stringsSize <= mappingSize &&
+      h->recordsOffset % alignof(LibraryRecord) == 0 &&
+      h->recordsOffset + count * sizeof(LibraryRecord) <= mappingSize &&
+      h->byPathOffset % 4 == 0 && h->byPathOffset + count * 4 <= mappingSize &&
+      h->byLengthOffset % 4 == 0 &&
+      h->byLengthOffset + count * 4 <= mappingSize;
+  const char *base = (const char *)data;
+  if (!valid || base[h->stringsOffset + h->stringsSize - 1] != '\0') {
+    close();
+    return false;
+  }
+
+  header = h;
+  strings = base + h->stringsOffset;
+  records = (const LibraryRecord *)(base + h->recordsOffset);
+  byPathOrder = (const uint32_t *)(base + h->byPathOffset);
+  byLengthOrder = (const uint32_t *)(base + h->byLengthOffset);
+  replayLog(path + ".log");
+  return true;
+}
+
+void Library::close() {
+  if (mapping)
+    munmap(mapping, mappingSize);
+  mapping = nullptr;
+  mappingSize = 0;
+  header = nullptr;
+  strings = nullptr;
+  records = nullptr;
+  byPathOrder = byLengthOrder = nullptr;
+  logRecords.clear();
+  logStrings.clear();
+  logByPath.clear();
+  stale.clear();
+}
+
+// Later entries win. A record replaced further on is left in logRecords
+// until the end, then dropped.
+void Library::replayLog(const std::string &logPath) {
+  int fd = ::open(logPath.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return;
+  std::string log;
+  char buffer[64 * 1024];
+  ssize_t n;
+  while ((n = read(fd, buffer, sizeof(buffer))) > 0)
+    log.append(buffer, n);
+  ::close(fd);
+
+  LibraryLogHeader h;
+  if (log.size() < sizeof(h))
+    return;
+  memcpy(&h, log.data(), sizeof(h));
+  if (memcmp(h.magic, LIBRARY_LOG_MAGIC, sizeof(LIBRARY_LOG_MAGIC)) != 0 ||
+      h.version != LIBRARY_LOG_VERSION || h.generation != header->generation)
+    return;
+
+  auto markStale = [this](const LibraryRecord *record) {
+    if (!record)
+      return;
+    if (stale.empty())
+      stale.assign(size(), 0);
+    stale[record - records] = 1;
+  };
+
+  size_t pos = sizeof(h);
+  while (pos + sizeof(LibraryLogEntry) <= log.size()) {
+    LibraryLogEntry entry;
+    memcpy(&entry, log.data() + pos, sizeof(entry));
+    pos += sizeof(entry);
+    // Every payload ends with a string
+    if (entry.bytes == 0 || entry.bytes > log.size() - pos ||
+        log[pos + entry.bytes - 1] != '\0')
+      break;
+    const char *payload = log.data() + pos;
+    pos += entry.bytes;
+
+    if (entry.kind == LIBRARY_LOG_TRACK) {
+      if (entry.bytes <= sizeof(LibraryRecord))
+        break;
+      LibraryRecord rec;
+      memcpy(&rec, payload, sizeof(rec));
+      const char *recStrings = payload + sizeof(rec);
+      uint32_t recStringsSize = entry.bytes - sizeof(rec);
+      uint64_t base = header->stringsSize + logStrings.size();
+      bool valid = rec.path < recStringsSize &&
+                   base + recStringsSize < LIBRARY_NO_STRING;
+      for (int f = 0; f < TAG_FIELD_COUNT; ++f)
+        valid = valid && (rec.tags[f] == LIBRARY_NO_STRING ||
+                          rec.tags[f] < recStringsSize);
+      if (!valid)
+        break;
+      rec.path += (uint32_t)base;
+      for (int f = 0; f < TAG_FIELD_COUNT; ++f)
+        if (rec.tags[f] != LIBRARY_NO_STRING)
+          rec.tags[f] += (uint32_t)base;
+      logStrings.append(recStrings, recStringsSize);
+
+      const char *path = string(rec.path);
+      markStale(findMapped(path));
+      logByPath[path] = (uint32_t)logRecords.size();
+      logRecords.push_back(rec);
+    } else if (entry.kind == LIBRARY_LOG_REMOVE) {
+      logByPath.erase(payload);
+      markStale(findMapped(payload));
+    } else if (entry.kind == LIBRARY_LOG_REMOVE_DIR) {
+      size_t length = strlen(payload);
+      auto isUnder = [&](const char *path) {
+        return strncmp(path, payload, length) == 0 && path[length] == '/';
+      };
+      for (auto it = logByPath.begin(); it != logByPath.end();) {
+        if (isUnder(it->first.c_str()))
+          it = logByPath.erase(it);
+        else
+          ++it;
+      }
+      for (size_t i = 0; i < size(); ++i)
+        if (isUnder(string(records[i].path)))
+          markStale(&records[i]);
+    } else {
+      break; // Written by a newer version
+    }
+  }
+
+  if (logByPath.size() < logRecords.size()) {
+    std::vector<LibraryRecord> live;
+    live.reserve(logByPath.size());
+    for (auto &entry : logByPath) {
+      live.push_back(logRecords[entry.second]);
+      entry.second = (uint32_t)live.size() - 1;
+    }
+    logRecords.swap(live);
+  }
+}
+
+const char *Library::string(uint32_t offset) const {
+  if (!header)
+    return "";
+  if (offset < header->stringsSize)
+    return strings + offset;
+  uint64_t logOffset = offset - header->stringsSize;
+  return logOffset < logStrings.size() ? logStrings.data() + logOffset : "";
+}
+
+const LibraryRecord *Library::find(const char *path) const {
+  if (!logByPath.empty()) {
+    auto it = logByPath.find(path);
+    if (it != logByPath.end())
+      return &logRecords[it->second];
+  }
+  const LibraryRecord *record = findMapped(path);
+  return record && !isStale(record - records) ? record : nullptr;
+}
+
+const LibraryRecord *Library::findMapped(const char *path) const {
+  size_t lo = 0;
+  size_t hi = size();
+  while (lo < hi) {
+    size_t mid = (lo + hi) / 2;
+    uint32_t index = byPathOrder[mid];
+    if (index >= size())
+      return nullptr;
+    int cmp = strcmp(string(records[index].path), path);
+    if (cmp == 0)
+      return &records[index];
+    if (cmp < 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return nullptr;
+}
+
+TrackMeta Library::toMeta(const LibraryRecord &record) const {
+  TrackMeta meta;
+  meta.size = record.size;
+  meta.mtimeNs = record.mtimeNs;
+  meta.info.ok = (record.flags & LIBRARY_PROBED) != 0;
+  meta.info.estimated = (record.flags & LIBRARY_ESTIMATED) != 0;
+  meta.info.format = (AudioFormat)record.format;
+  meta.info.lengthFrames = record.lengthFrames;
+  meta.info.sampleRate = record.sampleRate;
+  meta.info.channels = record.channels;
+  meta.onDisk = false;
+  return meta;
+}
+
+ScannedTrack Library::toTrack(const LibraryRecord &record) const {
+  ScannedTrack track;
+  track.path = string(record.path);
+  track.meta = toMeta(record);
+  for (int f = 0; f < TAG_FIELD_COUNT; ++f) {
+    if (record.tags[f] != LIBRARY_NO_STRING)
+      track.tags.field[f] = string(record.tags[f]);
+  }
+  return track;
+}
+
+// Distinct for every save, so an index never matches an older one's log.
+static uint64_t newGeneration() {
+  std::random_device device;
+  uint64_t now = std::chrono::system_clock::now().time_since_epoch().count();
+  return (((uint64_t)device() << 32) | device()) ^ now;
+}
+
+static uint64_t alignUp(uint64_t value, uint64_t alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+// Everything but the strings, which the caller places.
+static void fillRecord(LibraryRecord &rec, const TrackMeta &track) {
+  rec.size = track.size;
+  rec.mtimeNs = track.mtimeNs;
+  rec.format = track.info.format;
+  rec.lengthFrames = track.info.lengthFrames;
+  rec.sampleRate = track.info.sampleRate;
+  rec.channels = (uint16_t)track.info.channels;
+  rec.flags = (track.info.ok ? LIBRARY_PROBED : 0) |
+              (track.info.estimated ? LIBRARY_ESTIMATED : 0);
+}
+
+bool Library::save(const std::string &path, const PathTable &paths,
+                   const std::vector<TrackId> &tracks,
+                   const std::vector<TrackMeta> &meta,
+                   const std::vector<uint32_t> &tagIds,
+                   const std::vector<std::string> &tagStrings,
+                   std::string &error) {
+  LibraryIndexHeader h;
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, LIBRARY_MAGIC, sizeof(LIBRARY_MAGIC));
+  h.version = LIBRARY_VERSION;
+  h.generation = newGeneration();
+  h.count = (uint32_t)tracks.size();
+
+  std::string pool;
+  std::vector<LibraryRecord> recs(tracks.size());
+  // Pool offset of each tag string, added on first use.
+  std::vector<uint32_t> tagOffsets(tagStrings.size(), LIBRARY_NO_STRING);
+  for (size_t i = 0; i < tracks.size(); ++i) {
+    const TrackMeta &track = meta[tracks[i]];
+    LibraryRecord &rec = recs[i];
+    memset(&rec, 0, sizeof(rec));
+    rec.path = (uint32_t)pool.size();
+    paths.appendPath(tracks[i], pool);
+    pool.push_back('\0');
+    for (int f = 0; f < TAG_FIELD_COUNT; ++f) {
+      uint32_t tag = tagIds[(size_t)tracks[i] * TAG_FIELD_COUNT + f];
+      if (tag != 0 && tagOffsets[tag] == LIBRARY_NO_STRING) {
+        tagOffsets[tag] = (uint32_t)pool.size();
+        pool += tagStrings[tag];
+        pool.push_back('\0');
+      }
+      rec.tags[f] = tag != 0 ? tagOffsets[tag] : LIBRARY_NO_STRING;
+    }
+    fillRecord(rec, track);
+  }
+  if (pool.empty())
+    pool.push_back('\0');
+  if (pool.size() >= LIBRARY_NO_STRING) {
+    error = "Library too large to index";
+    return false;
+  }
+
+  std::vector<uint32_t> byPath(tracks.size());
+  for (uint32_t i = 0; i < byPath.size(); ++i)
+    byPath[i] = i;
+  std::vector<uint32_t> byLength = byPath;
+  // find() binary-searches with strcmp, so this order must match it.
+  std::sort(byPath.begin(), byPath.end(), [&](uint32_t a, uint32_t b) {
+    return strcmp(pool.data() + recs[a].path, pool.data() + recs[b].path) < 0;
+  });
+  std::stable_sort(byLength.begin(), byLength.end(),
+                   [&](uint32_t a, uint32_t b) {
+                     return meta[tracks[a]].info.seconds() <
+                            meta[tracks[b]].info.seconds();
+                   });
+
+  h.stringsOffset = sizeof(h);
+  h.stringsSize = pool.size();
+  h.recordsOffset =
+      alignUp(h.stringsOffset + h.stringsSize, alignof(LibraryRecord));
+  h.byPathOffset = h.recordsOffset + recs.size() * sizeof(LibraryRecord);
+  h.byLengthOffset = h.byPathOffset + byPath.size() * 4;
+  h.fileSize = h.byLengthOffset + byLength.size() * 4;
+
+  std::string tmpPath = path + ".tmp";
+  FILE *file = fopen(tmpPath.c_str(), "wb");
+  if (!file) {
+    error = "Cannot write " + tmpPath;
+    return false;
+  }
+  static const char padding[8] = {0};
+  bool ok =
+      fwrite(&h, sizeof(h), 1, file) == 1 &&
+      fwrite(pool.data(), 1, pool.size(), file) == pool.size() &&
+      fwrite(padding, 1, h.recordsOffset - h.stringsOffset - h.stringsSize,
+             file) == h.recordsOffset - h.stringsOffset - h.stringsSize &&
+      fwrite(recs.data(), sizeof(LibraryRecord), recs.size(), file) ==
+          recs.size() &&
+      fwrite(byPath.data(), 4, byPath.size(), file) == byPath.size() &&
+      fwrite(byLength.data(), 4, byLength.size(), file) == byLength.size();
+  ok = fclose(file) == 0 && ok;
+  if (!ok || rename(tmpPath.c_str(), path.c_str()) != 0) {
+    error = "Cannot write " + path;
+    unlink(tmpPath.c_str());
+    return false;
+  }
+  // The new index holds everything logged so far. If this is never reached
+  // the old log's generation keeps it from being replayed.
+  unlink((path + ".log").c_str());
+  return true;
+}
+
+static void appendLogEntry(std::string &out, uint32_t kind,
+                           const std::string &payload) {
+  LibraryLogEntry entry;
+  entry.kind = kind;
+  entry.bytes = (uint32_t)payload.size();
+  out.append((const char *)&entry, sizeof(entry));
+  out += payload;
+}
+
+bool Library::appendLog(const std::string &path,
+                        const std::vector<ScannedTrack> &tracks,
+                        const std::vector<std::string> &removed,
+                        const std::vector<std::string> &removedDirs,
+                        std::string &error) {
+  LibraryIndexHeader index;
+  int indexFd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (indexFd < 0)
+    return false;
+  bool haveIndex = pread(indexFd, &index, sizeof(index), 0) == sizeof(index);
+  ::close(indexFd);
+  if (!haveIndex ||
+      memcmp(index.magic, LIBRARY_MAGIC, sizeof(LIBRARY_MAGIC)) != 0 ||
+      index.version != LIBRARY_VERSION)
+    return false;
+
+  std::string logPath = path + ".log";
+  int fd = ::open(logPath.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC,
+                  0644);
+  if (fd < 0) {
+    error = "Cannot write " + logPath;
+    return false;
+  }
+  // A log from another index generation is started over
+  LibraryLogHeader h;
+  bool fresh = pread(fd, &h, sizeof(h), 0) != sizeof(h) ||
+               memcmp(h.magic, LIBRARY_LOG_MAGIC, sizeof(LIBRARY_LOG_MAGIC)) !=
+                   0 ||
+               h.version != LIBRARY_LOG_VERSION ||
+               h.generation != index.generation;
+  struct stat logStat;
+  // Replaying costs as much as reading the log; past the index's own size
+  // a rewrite is cheaper for every later launch.
+  if (!fresh && fstat(fd, &logStat) == 0 &&
+      (uint64_t)logStat.st_size >= index.fileSize) {
+    ::close(fd);
+    return false;
+  }
+  if (fresh && ftruncate(fd, 0) != 0) {
+    ::close(fd);
+    error = "Cannot write " + logPath;
+    return false;
+  }
+
+  // The whole batch goes out in one write
+  std::string out;
+  if (fresh) {
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, LIBRARY_LOG_MAGIC, sizeof(LIBRARY_LOG_MAGIC));
+    h.version = LIBRARY_LOG_VERSION;
+    h.generation = index.generation;
+    out.append((const char *)&h, sizeof(h));
+  }
+  std::string payload;
+  for (const std::string &dir : removedDirs)
+    appendLogEntry(out, LIBRARY_LOG_REMOVE_DIR, dir + '\0');
+  for (const std::string &file : removed)
+    appendLogEntry(out, LIBRARY_LOG_REMOVE, file + '\0');
+  for (const ScannedTrack &track : tracks) {
+    LibraryRecord rec;
+    memset(&rec, 0, sizeof(rec));
+    fillRecord(rec, track.meta);
+    payload.assign((const char *)&rec, sizeof(rec));
+    rec.path = 0;
+    payload += track.path;
+    payload.push_back('\0');
+    for (int f = 0; f < TAG_FIELD_COUNT; ++f) {
+      const std::string &tag = track.tags.field[f];
+      rec.tags[f] = LIBRARY_NO_STRING;
+      if (!tag.empty()) {
+        rec.tags[f] = (uint32_t)(payload.size() - sizeof(rec));
+        payload += tag;
+        payload.push_back('\0');
+      }
+    }
+    memcpy(&payload[0], &rec, sizeof(rec));
+    appendLogEntry(out, LIBRARY_LOG_TRACK, payload);
+  }
+
+  off_t start = lseek(fd, 0, SEEK_END);
+  size_t written = 0;
+  while (written < out.size()) {
+    ssize_t n = write(fd, out.data() + written, out.size() - written);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      break;
+    written += (size_t)n;
+  }
+  bool ok = written == out.size();
+  // A torn entry would hide every entry after it; without the log the
+  // next launch just has more to revalidate.
+  if (!ok && (start < 0 || ftruncate(fd, start) != 0))
+    unlink(logPath.c_str());
+  ok = ::close(fd) == 0 && ok;
+  if (!ok)
+    error = "Cannot write " + logPath;
+  return ok;
+}
@@ -0,0 +1,170 @@
+#ifndef LIBRARY_H
+#define LIBRARY_H
+
+#include "AudioProbe.h"
+#include "PathTable.h"
+#include "TagReader.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <sys/stat.h>
+#include <unordered_map>
+#include <vector>
+
+// Everything the library knows about a track except its path.
+struct TrackMeta {
+  uint64_t size = 0;
+  int64_t mtimeNs = 0;
+  AudioProbeInfo info;
+  // False for tracks loaded from the index until a scan finds them again.
+  bool onDisk = true;
+};
+
+// A track on its way from the scanner, watcher or index into a TrackList.
+struct ScannedTrack {
+  std::string path; // Relative to the scan root
+  TrackMeta meta;
+  TrackTags tags;
+};
+
+// Copies size and mtime, which decide whether an index record is current.
+void fillTrackStat(TrackMeta &meta, const struct stat &st);
+
+const uint32_t LIBRARY_NO_STRING = 0xFFFFFFFFu;
+
+enum LibraryRecordFlags {
+  LIBRARY_PROBED = 1,
+  LIBRARY_ESTIMATED = 2
+};
+
+// Fixed-size record; strings are offsets into the index's string pool.
+struct LibraryRecord {
+  uint32_t path;
+  uint32_t tags[TAG_FIELD_COUNT]; // By TagField, LIBRARY_NO_STRING if unset
+  uint32_t format;                // AudioFormat from the magic bytes
+  uint64_t size;
+  int64_t mtimeNs;
+  uint64_t lengthFrames;
+  uint32_t sampleRate;
+  uint16_t channels;
+  uint16_t flags;
+};
+
+struct LibraryIndexHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t count;
+  uint64_t fileSize;
+  uint64_t stringsOffset;
+  uint64_t stringsSize;
+  uint64_t recordsOffset;
+  uint64_t byPathOffset;   // uint32_t[count], record indices sorted by path
+  uint64_t byLengthOffset; // uint32_t[count], sorted by duration
+  uint64_t generation;     // New on every save; its log must carry it too
+};
+
+// Header of the log next to an index (path + ".log"); entries follow it.
+// A log whose generation is not its index's is left over from an older
+// index and ignored.
+struct LibraryLogHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+  uint64_t generation;
+};
+
+enum LibraryLogKind {
+  LIBRARY_LOG_TRACK = 1,     // A LibraryRecord, then its strings
+  LIBRARY_LOG_REMOVE = 2,    // A path
+  LIBRARY_LOG_REMOVE_DIR = 3 // A directory; everything under it is gone
+};
+
+// Precedes each log entry. String offsets in a logged record are relative
+// to the strings after it; entries cut short by a crash are ignored.
+struct LibraryLogEntry {
+  uint32_t kind;
+  uint32_t bytes; // Payload after this header
+};
+
+// Read-only view of an on-disk library index. The file is mapped, not
+// read, so opening even a large library costs a single page-in; records
+// are only touched when they are used. Changes made since the index was
+// written are kept in its log and replayed over the mapped records.
+class Library {
+public:
+  Library() = default;
+  ~Library();
+  Library(const Library &) = delete;
+  Library &operator=(const Library &) = delete;
+
+  // Maps path and checks its header, then replays its log. Returns false if
+  // the file is missing, from another version or truncated.
+  bool open(const std::string &path);
+  void close();
+
+  size_t size() const { return header ? header->count : 0; }
+  const LibraryRecord &record(size_t index) const { return records[index]; }
+  const char *string(uint32_t offset) const;
+  const uint32_t *byPath() const { return byPathOrder; }
+  const uint32_t *byLength() const { return byLengthOrder; }
+
+  // Records added or updated by the log. They replace any mapped record
+  // with the same path, and their strings are read through string() too.
+  size_t logSize() const { return logRecords.size(); }
+  const LibraryRecord &logRecord(size_t index) const {
+    return logRecords[index];
+  }
+  // True if the log replaced or removed the mapped record at index.
+  bool isStale(size_t index) const {
+    return index < stale.size() && stale[index];
+  }
+
+  // The log's record for path, or a binary search through the path
+  // permutation; NULL if absent or removed.
+  const LibraryRecord *find(const char *path) const;
+  TrackMeta toMeta(const LibraryRecord &record) const;
+  ScannedTrack toTrack(const LibraryRecord &record) const;
+
+  // Writes the listed tracks to a temporary file and renames it over path,
+  // so a mapped older index stays valid. meta is indexed by TrackId;
+  // tagIds holds TAG_FIELD_COUNT indices into tagStrings per TrackId, with
+  // 0 for an unset field. Each distinct tag string is stored once. On
+  // failure error says why; nothing is printed, since the UI may own the
+  // terminal.
+  static bool save(const std::string &path, const PathTable &paths,
+                   const std::vector<TrackId> &tracks,
+                   const std::vector<TrackMeta> &meta,
+                   const std::vector<uint32_t> &tagIds,
+                   const std::vector<std::string> &tagStrings,
+                   std::string &error);
+  // Appends tracks and removals to the log of the index at path, a write
+  // the size of the change rather than of the library. Returns false
+  // without an error if there is no index yet or the log has grown as
+  // large as the index; save() then rewrites it and starts a new log.
+  static bool appendLog(const std::string &path,
+                        const std::vector<ScannedTrack> &tracks,
+                        const std::vector<std::string> &removed,
+                        const std::vector<std::string> &removedDirs,
+                        std::string &error);
+
+private:
+  const LibraryRecord *findMapped(const char *path) const;
+  void replayLog(const std::string &logPath);
+
+  void *mapping = nullptr;
+  size_t mappingSize = 0;
+  const LibraryIndexHeader *header = nullptr;
+  const char *strings = nullptr;
+  const LibraryRecord *records = nullptr;
+  const uint32_t *byPathOrder = nullptr;
+  const uint32_t *byLengthOrder = nullptr;
+
+  // Replayed from the log. Offsets from the mapped pool's size up address
+  // logStrings.
+  std::vector<LibraryRecord> logRecords;
+  std::string logStrings;
+  std::unordered_map<std::string, uint32_t> logByPath;
+  std::vector<char> stale; // By mapped record index
+};
+
+#endif // LIBRARY_H
@@ -0,0 +1,212 @@
+#include "LibraryScanner.h"
+#include "LibraryWatcher.h"
+#include <algorithm>
+#include <cstring>
+#include <dirent.h>
+#include <strings.h>
+#include <sys/stat.h>
+
+bool isAudioFileName(const char *name) {
+  static const char *const extensions[] = {".mp3", ".wav", ".wave", ".flac",
+                                           ".fla", ".ogg", ".oga"};
+  const char *dot = strrchr(name, '.');
+  if (!dot)
+    return true; // Ripped or downloaded files often have no extension
+  for (const char *extension : extensions) {
+    if (strcasecmp(dot, extension) == 0)
+      return true;
+  }
+  return false;
+}
+
+static std::string joinPath(const std::string &dir, const char *name) {
+  return dir.empty() ? std::string(name) : dir + "/" + name;
+}
+
+LibraryScanner::LibraryScanner(const std::string &root, const Library *cache,
+                               LibraryWatcher *watcher, unsigned threads,
+                               unsigned ioDepth)
+    : cache(cache), watcher(watcher), pipeline(root, ioDepth) {
+  // Walking is bound by directory reads and stats rather than CPU, so keep
+  // a few requests in flight even on small machines.
+  numWorkers = threads ? threads
+                       : std::max(4u, std::thread::hardware_concurrency());
+  queues.reset(new WorkQueue[numWorkers]);
+
+  // "." is kept as an empty prefix so top-level tracks are plain names.
+  std::string path = root == "." ? "" : root;
+  while (path.size() > 1 && path.back() == '/')
+    path.pop_back();
+  struct stat st;
+  if (stat(path.empty() ? "." : path.c_str(), &st) != 0 || !S_ISDIR(st.st_mode))
+    return;
+  visited.insert({(uint64_t)st.st_dev, (uint64_t)st.st_ino});
+  push(0, addDirectory(path));
+
+  for (unsigned i = 0; i < numWorkers; ++i)
+    workers.emplace_back(&LibraryScanner::workerLoop, this, i);
+}
+
+LibraryScanner::~LibraryScanner() {
+  // Releases workers blocked on a full pipeline first.
+  pipeline.stop();
+  {
+    std::lock_guard<std::mutex> lock(idleLock);
+    stopping = true;
+  }
+  idleCv.notify_all();
+  for (auto &worker : workers)
+    worker.join();
+}
+
+size_t LibraryScanner::poll(std::vector<ScannedTrack> &out) {
+  size_t count;
+  {
+    std::lock_guard<std::mutex> lock(readyLock);
+    count = ready.size();
+    out.insert(out.end(), std::make_move_iterator(ready.begin()),
+               std::make_move_iterator(ready.end()));
+    ready.clear();
+  }
+  return count + pipeline.poll(out);
+}
+
+ScanProgress LibraryScanner::getProgress() const {
+  ScanProgress progress;
+  progress.directories = dirsScanned.load();
+  progress.files = filesFound.load();
+  progress.cached = filesCached.load();
+  progress.metadata = pipeline.getProgress();
+  progress.ioDepth = pipeline.getIoDepth();
+  return progress;
+}
+
+uint32_t LibraryScanner::addDirectory(std::string path) {
+  std::lock_guard<std::mutex> lock(dirLock);
+  dirPaths.push_back(std::move(path));
+  return (uint32_t)(dirPaths.size() - 1);
+}
+
+void LibraryScanner::push(unsigned worker, uint32_t dir) {
+  // pending first, so it never reads zero while work is still queued.
+  ++pending;
+  {
+    std::lock_guard<std::mutex> lock(queues[worker].lock);
+    queues[worker].dirs.push_back(dir);
+  }
+  {
+    std::lock_guard<std::mutex> lock(idleLock);
+    ++queued;
+  }
+  idleCv.notify_one();
+}
+
+bool LibraryScanner::take(unsigned worker, uint32_t &dir) {
+  // Own work from the back keeps the walk depth-first and the directory
+  // cache warm; steals from the front take the largest remaining subtrees.
+  for (unsigned i = 0; i < numWorkers; ++i) {
+    WorkQueue &queue = queues[(worker + i) % numWorkers];
+    std::lock_guard<std::mutex> lock(queue.lock);
+    if (queue.dirs.empty())
+      continue;
+    if (i == 0) {
+      dir = queue.dirs.back();
+      queue.dirs.pop_back();
+    } else {
+      dir = queue.dirs.front();
+      queue.dirs.pop_front();
+    }
+    --queued;
+    return true;
+  }
+  return false;
+}
+
+void LibraryScanner::scanDirectory(unsigned worker, uint32_t dir) {
+  std::string path;
+  {
+    std::lock_guard<std::mutex> lock(dirLock);
+    path = dirPaths[dir];
+  }
+  if (watcher)
+    watcher->watchDirectory(path);
+  DIR *handle = opendir(path.empty() ? "." : path.c_str());
+  if (!handle)
+    return;
+  int fd = dirfd(handle);
+
+  std::vector<ScannedTrack> found;
+  while (struct dirent *entry = readdir(handle)) {
+    if (stopping)
+      break;
+    // Skips ".", ".." and hidden files and directories.
+    if (entry->d_name[0] == '.')
+      continue;
+
+    bool isDir = entry->d_type == DT_DIR;
+    bool isFile = entry->d_type == DT_REG;
+    if (isFile && !isAudioFileName(entry->d_name))
+      continue;
+    // Follows symlinks; the visited set stops loops.
+    struct stat st;
+    if (fstatat(fd, entry->d_name, &st, 0) != 0)
+      continue;
+    isDir = S_ISDIR(st.st_mode);
+    isFile = S_ISREG(st.st_mode);
+
+    if (isDir) {
+      bool fresh;
+      {
+        std::lock_guard<std::mutex> lock(dirLock);
+        fresh = visited.insert({(uint64_t)st.st_dev, (uint64_t)st.st_ino})
+                    .second;
+      }
+      if (fresh)
+        push(worker, addDirectory(joinPath(path, entry->d_name)));
+    } else if (isFile && isAudioFileName(entry->d_name)) {
+      ScannedTrack track;
+      track.path = joinPath(path, entry->d_name);
+      fillTrackStat(track.meta, st);
+      const LibraryRecord *record =
+          cache ? cache->find(track.path.c_str()) : nullptr;
+      ++filesFound;
+      if (record && record->size == track.meta.size &&
+          record->mtimeNs == track.meta.mtimeNs) {
+        ScannedTrack cached = cache->toTrack(*record);
+        track.meta.info = cached.meta.info;
+        track.tags = std::move(cached.tags);
+        found.push_back(std::move(track));
+        ++filesCached;
+      } else {
+        pipeline.submit(std::move(track));
+      }
+    }
+  }
+  closedir(handle);
+
+  if (!found.empty()) {
+    std::lock_guard<std::mutex> lock(readyLock);
+    ready.insert(ready.end(), std::make_move_iterator(found.begin()),
+                 std::make_move_iterator(found.end()));
+  }
+}
+
+void LibraryScanner::workerLoop(unsigned worker) {
+  for (;;) {
+    uint32_t dir;
+    if (take(worker, dir)) {
+      scanDirectory(worker, dir);
+      ++dirsScanned;
+      if (pending.fetch_sub(1) == 1) {
+        std::lock_guard<std::mutex> lock(idleLock);
+        idleCv.notify_all();
+      }
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(idleLock);
+    idleCv.wait(lock,
+                [&] { return stopping || queued > 0 || pending == 0; });
+    if (stopping || pending == 0)
+      return;
+  }
+}
@@ -0,0 +1,95 @@
+#ifndef LIBRARY_SCANNER_H
+#define LIBRARY_SCANNER_H
+
+#include "Library.h"
+#include "MetadataPipeline.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+class LibraryWatcher;
+
+// Names worth reading: audio extensions in any case, or none at all. The
+// contents decide; files that turn out not to be audio are dropped.
+bool isAudioFileName(const char *name);
+
+struct ScanProgress {
+  size_t directories = 0;
+  size_t files = 0;  // Files with audio names found so far
+  size_t cached = 0; // Of those, reused from the index without reading
+  PipelineProgress metadata;
+  unsigned ioDepth = 0;
+};
+
+// Walks a directory tree on a work-stealing pool: each worker scans
+// directories from its own deque depth-first and steals the oldest entry
+// of another worker's deque when it runs dry. With a cache, files whose
+// size and mtime match their index record reuse it and are only stat'ed;
+// the rest go through a MetadataPipeline, so their reads are bounded and
+// overlap with the walk. Results can be collected with poll() while the
+// scan is still running. With a watcher, every directory is registered
+// with it before being read.
+class LibraryScanner {
+public:
+  explicit LibraryScanner(const std::string &root,
+                          const Library *cache = nullptr,
+                          LibraryWatcher *watcher = nullptr,
+                          unsigned threads = 0, unsigned ioDepth = 0);
+  ~LibraryScanner();
+
+  // Moves the tracks found since the last call to the end of out and
+  // returns how many were added.
+  size_t poll(std::vector<ScannedTrack> &out);
+  // Walk finished and every file's metadata read.
+  bool isDone() const { return pending.load() == 0 && pipeline.isIdle(); }
+  size_t getDirectoriesScanned() const { return dirsScanned.load(); }
+  ScanProgress getProgress() const;
+
+private:
+  struct WorkQueue {
+    std::mutex lock;
+    std::deque<uint32_t> dirs;
+  };
+
+  uint32_t addDirectory(std::string path);
+  void push(unsigned worker, uint32_t dir);
+  bool take(unsigned worker, uint32_t &dir);
+  void scanDirectory(unsigned worker, uint32_t dir);
+  void workerLoop(unsigned worker);
+
+  // Every directory's path is stored once; files only reference it.
+  std::mutex dirLock;
+  std::deque<std::string> dirPaths;
+  // (st_dev, st_ino) of every directory entered, so symlink loops and
+  // repeated links to the same tree are walked only once.
+  std::set<std::pair<uint64_t, uint64_t>> visited;
+
+  const Library *cache;
+  LibraryWatcher *watcher;
+  std::unique_ptr<WorkQueue[]> queues;
+  unsigned numWorkers;
+  std::vector<std::thread> workers;
+  std::mutex idleLock;
+  std::condition_variable idleCv;
+  std::atomic<size_t> queued{0};  // Pushed, not yet taken
+  std::atomic<size_t> pending{0}; // Pushed, not yet finished
+  std::atomic<size_t> dirsScanned{0};
+  std::atomic<size_t> filesFound{0};
+  std::atomic<size_t> filesCached{0};
+  std::atomic<bool> stopping{false};
+
+  MetadataPipeline pipeline;
+
+  std::mutex readyLock;
+  std::vector<ScannedTrack> ready; // Tracks taken from the cache
+};
+
+#endif // LIBRARY_SCANNER_H
@@ -0,0 +1,277 @@
+#include "LibraryWatcher.h"
+#include "EventLoop.h"
+#include "LibraryScanner.h"
+#include <algorithm>
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <set>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+// Quiet period that ends a batch, and the longest a batch may be held
+// while events keep arriving.
+static const std::chrono::milliseconds BATCH_QUIET(500);
+static const std::chrono::milliseconds BATCH_MAX_DELAY(5000);
+
+#ifdef __linux__
+
+static std::string joinPath(const std::string &dir, const char *name) {
+  return dir.empty() ? std::string(name) : dir + "/" + name;
+}
+
+static bool hasDirPrefix(const std::string &path, const std::string &dir) {
+  return path.size() > dir.size() && path.compare(0, dir.size(), dir) == 0 &&
+         path[dir.size()] == '/';
+}
+
+static const uint32_t WATCH_MASK = IN_CREATE | IN_CLOSE_WRITE | IN_DELETE |
+                                   IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR;
+
+LibraryWatcher::LibraryWatcher() {
+  fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (fd < 0)
+    return;
+  if (pipe(wakePipe) != 0) {
+    close(fd);
+    fd = -1;
+    return;
+  }
+  fcntl(wakePipe[0], F_SETFL, O_NONBLOCK);
+  thread = std::thread(&LibraryWatcher::watchLoop, this);
+}
+
+LibraryWatcher::~LibraryWatcher() {
+  if (fd < 0)
+    return;
+  stopping = true;
+  char byte = 0;
+  (void)!write(wakePipe[1], &byte, 1);
+  thread.join();
+  close(wakePipe[0]);
+  close(wakePipe[1]);
+  close(fd);
+}
+
+void LibraryWatcher::watchDirectory(const std::string &path) {
+  if (fd < 0)
+    return;
+  // Adding an inode that is already watched returns its existing
+  // descriptor, so rescans do not pile up watches.
+  int wd = inotify_add_watch(fd, path.empty() ? "." : path.c_str(), WATCH_MASK);
+  if (wd < 0)
+    return;
+  std::lock_guard<std::mutex> lock(dirLock);
+  dirs[wd] = path;
+}
+
+size_t LibraryWatcher::getWatchCount() {
+  std::lock_guard<std::mutex> lock(dirLock);
+  return dirs.size();
+}
+
+void LibraryWatcher::watchLoop() {
+  using Clock = std::chrono::steady_clock;
+  Clock::time_point first, last;
+  bool pending = false;
+  alignas(struct inotify_event) char buffer[16384];
+
+  while (!stopping) {
+    int timeout = -1;
+    if (pending) {
+      auto deadline = std::min(last + BATCH_QUIET, first + BATCH_MAX_DELAY);
+      auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(
+          deadline - Clock::now());
+      timeout = std::max(0, (int)wait.count());
+    }
+
+    struct pollfd fds[2] = {{fd, POLLIN, 0}, {wakePipe[0], POLLIN, 0}};
+    if (::poll(fds, 2, timeout) < 0)
+      continue;
+    if (fds[1].revents & POLLIN) {
+      char drain[16];
+      while (read(wakePipe[0], drain, sizeof(drain)) > 0) {
+      }
+    }
+
+    if (fds[0].revents & POLLIN) {
+      ssize_t bytes;
+      while ((bytes = read(fd, buffer, sizeof(buffer))) > 0) {
+        for (char *p = buffer; p < buffer + bytes;) {
+          const struct inotify_event *event = (const struct inotify_event *)p;
+          handleEvent(event->wd, event->mask, event->len ? event->name : "");
+          p += sizeof(struct inotify_event) + event->len;
+        }
+      }
+      last = Clock::now();
+      if (!pending)
+        first = last;
+      pending = true;
+    }
+
+    if (pending &&
+        Clock::now() >= std::min(last + BATCH_QUIET, first + BATCH_MAX_DELAY)) {
+      flush();
+      notifyWakeFd(notifyFd.load());
+      pending = false;
+    }
+  }
+}
+
+void LibraryWatcher::handleEvent(int wd, uint32_t mask, const char *name) {
+  if (mask & IN_Q_OVERFLOW) {
+    pendingRescan = true;
+    return;
+  }
+  std::string dir;
+  {
+    std::lock_guard<std::mutex> lock(dirLock);
+    auto it = dirs.find(wd);
+    if (it == dirs.end())
+      return;
+    if (mask & IN_IGNORED) {
+      dirs.erase(it);
+      return;
+    }
+    dir = it->second;
+  }
+  // Hidden entries are skipped like in the scanner; this also hides the
+  // temporary files rsync and editors write before renaming into place.
+  if (name[0] == '\0' || name[0] == '.')
+    return;
+
+  std::string path = joinPath(dir, name);
+  if (mask & IN_ISDIR) {
+    if (mask & (IN_CREATE | IN_MOVED_TO)) {
+      addTree(path);
+    } else if (mask & (IN_DELETE | IN_MOVED_FROM)) {
+      pendingRemovedDirs.push_back(path);
+      if (mask & IN_MOVED_FROM)
+        unwatchTree(path);
+    }
+    return;
+  }
+  if (!isAudioFileName(name))
+    return;
+  if (mask & (IN_CREATE | IN_CLOSE_WRITE | IN_MOVED_TO))
+    pendingFiles[path] = true;
+  else if (mask & (IN_DELETE | IN_MOVED_FROM))
+    pendingFiles[path] = false;
+}
+
+// A directory that appears already has contents (mv, rsync of a whole
+// album), and nothing inside it was watched yet.
+void LibraryWatcher::addTree(const std::string &path) {
+  watchDirectory(path);
+  DIR *handle = opendir(path.c_str());
+  if (!handle)
+    return;
+  while (struct dirent *entry = readdir(handle)) {
+    if (entry->d_name[0] == '.')
+      continue;
+    std::string child = joinPath(path, entry->d_name);
+    struct stat st;
+    if (stat(child.c_str(), &st) != 0)
+      continue;
+    if (S_ISDIR(st.st_mode))
+      addTree(child);
+    else if (S_ISREG(st.st_mode) && isAudioFileName(entry->d_name))
+      pendingFiles[child] = true;
+  }
+  closedir(handle);
+}
+
+// Watches follow inodes, so a directory moved out of the library would
+// keep reporting under its old path.
+void LibraryWatcher::unwatchTree(const std::string &path) {
+  std::lock_guard<std::mutex> lock(dirLock);
+  for (auto it = dirs.begin(); it != dirs.end();) {
+    if (it->second == path || hasDirPrefix(it->second, path)) {
+      inotify_rm_watch(fd, it->first);
+      it = dirs.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+#else
+
+LibraryWatcher::LibraryWatcher() {}
+LibraryWatcher::~LibraryWatcher() {}
+void LibraryWatcher::watchDirectory(const std::string &path) {}
+size_t LibraryWatcher::getWatchCount() { return 0; }
+void LibraryWatcher::watchLoop() {}
+void LibraryWatcher::handleEvent(int wd, uint32_t mask, const char *name) {}
+void LibraryWatcher::addTree(const std::string &path) {}
+void LibraryWatcher::unwatchTree(const std::string &path) {}
+
+#endif
+
+// Probing happens here, on the watch thread, so applying an update on the
+// UI thread is only a merge.
+void LibraryWatcher::flush() {
+  LibraryUpdate update;
+  update.rescan = pendingRescan;
+  update.removedDirs.swap(pendingRemovedDirs);
+  for (const auto &entry : pendingFiles) {
+    ScannedTrack track;
+    track.path = entry.first;
+    struct stat st;
+    if (entry.second && stat(track.path.c_str(), &st) == 0 &&
+        S_ISREG(st.st_mode) &&
+        readMetadata(track.path, track.meta.info, track.tags)) {
+      fillTrackStat(track.meta, st);
+      update.changed.push_back(std::move(track));
+    } else {
+      update.removed.push_back(entry.first);
+    }
+  }
+  pendingFiles.clear();
+  pendingRescan = false;
+
+  // Merge with a batch the UI has not picked up yet; newer events for a
+  // path replace older ones.
+  std::lock_guard<std::mutex> lock(readyLock);
+  std::set<std::string> gone(update.removed.begin(), update.removed.end());
+  std::set<std::string> changed;
+  for (const auto &track : update.changed)
+    changed.insert(track.path);
+  auto superseded = [&](const ScannedTrack &track) {
+    if (gone.count(track.path) || changed.count(track.path))
+      return true;
+    for (const auto &dir : update.removedDirs)
+      if (track.path.compare(0, dir.size() + 1, dir + "/") == 0)
+        return true;
+    return false;
+  };
+  ready.changed.erase(
+      std::remove_if(ready.changed.begin(), ready.changed.end(), superseded),
+      ready.changed.end());
+  ready.removed.erase(std::remove_if(ready.removed.begin(), ready.removed.end(),
+                                     [&](const std::string &path) {
+                                       return changed.count(path) > 0;
+                                     }),
+                      ready.removed.end());
+  ready.rescan = ready.rescan || update.rescan;
+  ready.removedDirs.insert(ready.removedDirs.end(), update.removedDirs.begin(),
+                           update.removedDirs.end());
+  ready.removed.insert(ready.removed.end(), update.removed.begin(),
+                       update.removed.end());
+  ready.changed.insert(ready.changed.end(),
+                       std::make_move_iterator(update.changed.begin()),
+                       std::make_move_iterator(update.changed.end()));
+}
+
+bool LibraryWatcher::poll(LibraryUpdate &update) {
+  std::lock_guard<std::mutex> lock(readyLock);
+  if (ready.empty())
+    return false;
+  update = std::move(ready);
+  ready = LibraryUpdate();
+  return true;
+}
@@ -0,0 +1,79 @@
+#ifndef LIBRARY_WATCHER_H
+#define LIBRARY_WATCHER_H
+
+#include "Library.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// One debounced batch of library changes.
+struct LibraryUpdate {
+  std::vector<ScannedTrack> changed;    // Added or modified, already probed
+  std::vector<std::string> removed;     // Files deleted or renamed away
+  std::vector<std::string> removedDirs; // Directories deleted or renamed away
+  // The kernel dropped events; only a full rescan is reliable.
+  bool rescan = false;
+
+  bool empty() const {
+    return changed.empty() && removed.empty() && removedDirs.empty() &&
+           !rescan;
+  }
+};
+
+// Watches the library directories with inotify and turns the event stream
+// into LibraryUpdates. Events are coalesced per path and held until the
+// tree has been quiet for a moment, so copying an album in (or an rsync of
+// thousands of files) produces one update instead of one per file.
+// Without inotify (non-Linux) the watcher is inactive and poll() never
+// returns anything.
+class LibraryWatcher {
+public:
+  LibraryWatcher();
+  ~LibraryWatcher();
+  LibraryWatcher(const LibraryWatcher &) = delete;
+  LibraryWatcher &operator=(const LibraryWatcher &) = delete;
+
+  bool isActive() const { return fd >= 0; }
+  // Starts watching one directory (not its subdirectories). Thread-safe;
+  // the scanner calls it for every directory before reading it, so
+  // nothing created during the scan is missed.
+  void watchDirectory(const std::string &path);
+  // Moves the next finished batch into update. Returns false if none.
+  bool poll(LibraryUpdate &update);
+  // fd gets a notifyWakeFd() whenever a batch is ready for poll().
+  void setNotifyFd(int fd) { notifyFd = fd; }
+  size_t getWatchCount();
+
+private:
+  void watchLoop();
+  void handleEvent(int wd, uint32_t mask, const char *name);
+  void addTree(const std::string &path);
+  void unwatchTree(const std::string &path);
+  void flush();
+
+  int fd = -1;
+  int wakePipe[2] = {-1, -1};
+  std::thread thread;
+  std::atomic<bool> stopping{false};
+  std::atomic<int> notifyFd{-1};
+
+  std::mutex dirLock;
+  std::unordered_map<int, std::string> dirs; // Watch descriptor -> path
+
+  // Only touched by the watch thread. true = present, false = gone; the
+  // last event for a path wins.
+  std::map<std::string, bool> pendingFiles;
+  std::vector<std::string> pendingRemovedDirs;
+  bool pendingRescan = false;
+
+  std::mutex readyLock;
+  LibraryUpdate ready;
+};
+
+#endif // LIBRARY_WATCHER_H
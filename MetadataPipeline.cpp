@@ -0,0 +1,263 @@
+#include "MetadataPipeline.h"
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/vfs.h>
+#endif
+
+// Reads up to size bytes at offset into buffer, resized to what was read.
+static bool readInto(int fd, std::vector<unsigned char> &buffer, size_t size,
+                     uint64_t offset) {
+  buffer.resize(size);
+  ssize_t got = size > 0 ? pread(fd, buffer.data(), size, offset) : 0;
+  buffer.resize(got > 0 ? got : 0);
+  return got >= 0;
+}
+
+// readHeaders once path is open; the caller closes fd.
+static bool readHeadersFrom(int fd, FileHeaders &headers) {
+  struct stat st;
+  if (fstat(fd, &st) != 0)
+    return false;
+  headers.fileSize = st.st_size;
+  uint64_t size = headers.fileSize;
+  if (!readInto(fd, headers.head,
+                std::min<uint64_t>(TAG_HEAD_BYTES, size), 0) ||
+      headers.head.empty())
+    return false;
+
+  // The audio probe needs PROBE_HEAD_BYTES from the end of the ID3v2 tag,
+  // which usually lies within head; only long tags (artwork) cost a read.
+  headers.audioOffset = id3v2TagSize(headers.head.data(), headers.head.size());
+  const unsigned char *audio = headers.head.data() + headers.audioOffset;
+  size_t audioSize = headers.head.size() > headers.audioOffset
+                         ? headers.head.size() - headers.audioOffset
+                         : 0;
+  if (audioSize < PROBE_HEAD_BYTES && headers.head.size() < size) {
+    if (headers.audioOffset >= size ||
+        !readInto(fd, headers.audio,
+                  std::min<uint64_t>(PROBE_HEAD_BYTES,
+                                     size - headers.audioOffset),
+                  headers.audioOffset))
+      return false;
+    audio = headers.audio.data();
+    audioSize = headers.audio.size();
+  }
+
+  // Files that are not audio stop here, before the tail read.
+  if (sniffFormat(audio, audioSize, headers.audioOffset > 0) == AUDIO_UNKNOWN)
+    return true;
+  // Ogg needs the last page's granule; everything else just ID3v1.
+  bool ogg = audioSize >= 4 && memcmp(audio, "OggS", 4) == 0;
+  uint64_t want = std::min<uint64_t>(ogg ? PROBE_TAIL_BYTES : 128, size);
+  return readInto(fd, headers.tail, want, size - want);
+}
+
+bool readHeaders(const std::string &path, FileHeaders &headers) {
+  headers = FileHeaders();
+  headers.path = path;
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return false;
+  bool ok = readHeadersFrom(fd, headers);
+  close(fd);
+  return ok;
+}
+
+void parseHeaders(const FileHeaders &headers, AudioProbeInfo &info,
+                  TrackTags &tags) {
+  info = AudioProbeInfo();
+  tags = TrackTags();
+  if (headers.head.empty())
+    return;
+  const unsigned char *audio;
+  size_t audioSize;
+  if (!headers.audio.empty()) {
+    audio = headers.audio.data();
+    audioSize = headers.audio.size();
+  } else if (headers.audioOffset < headers.head.size()) {
+    audio = headers.head.data() + headers.audioOffset;
+    audioSize = std::min<size_t>(PROBE_HEAD_BYTES,
+                                 headers.head.size() - headers.audioOffset);
+  } else {
+    audio = nullptr;
+    audioSize = 0;
+  }
+  if (audioSize > 0)
+    probeBuffers(audio, audioSize, headers.audioOffset, headers.tail.data(),
+                 headers.tail.size(), headers.fileSize, info);
+  if (info.format == AUDIO_UNKNOWN)
+    return;
+  parseTags(headers.path.c_str(), headers.fileSize, headers.head.data(),
+            headers.head.size(), headers.tail.data(), headers.tail.size(),
+            tags);
+}
+
+bool readMetadata(const std::string &path, AudioProbeInfo &info,
+                  TrackTags &tags) {
+  FileHeaders headers;
+  if (readHeaders(path, headers)) {
+    parseHeaders(headers, info, tags);
+    return info.format != AUDIO_UNKNOWN;
+  }
+  info = AudioProbeInfo();
+  tags = TrackTags();
+  return true;
+}
+
+unsigned defaultIoDepth(const std::string &path) {
+#ifdef __linux__
+  struct statfs fs;
+  if (statfs(path.empty() ? "." : path.c_str(), &fs) == 0) {
+    switch ((unsigned long)fs.f_type) {
+    case 0x6969:     // NFS
+    case 0x517B:     // SMB
+    case 0xFF534D42: // CIFS
+    case 0xFE534D42: // SMB2
+    case 0x65735546: // FUSE (sshfs, rclone, ...)
+    case 0x00C36400: // Ceph
+      return 2;
+    }
+  }
+#else
+  (void)path;
+#endif
+  return 8;
+}
+
+MetadataPipeline::MetadataPipeline(const std::string &root, unsigned ioDepth,
+                                   unsigned parsers)
+    : ioDepth(ioDepth ? ioDepth : defaultIoDepth(root)) {
+  if (parsers == 0)
+    parsers = std::max(1u, std::thread::hardware_concurrency());
+  // Enough queued work to keep every stage busy across a burst, small
+  // enough that buffers in flight stay around a megabyte or two.
+  readCapacity = this->ioDepth * 16;
+  parseCapacity = parsers * 8;
+  for (unsigned i = 0; i < this->ioDepth; ++i)
+    threads.emplace_back(&MetadataPipeline::readerLoop, this);
+  for (unsigned i = 0; i < parsers; ++i)
+    threads.emplace_back(&MetadataPipeline::parserLoop, this);
+}
+
+MetadataPipeline::~MetadataPipeline() { stop(); }
+
+void MetadataPipeline::stop() {
+  {
+    std::lock_guard<std::mutex> lock(queueLock);
+    if (stopping && threads.empty())
+      return;
+    stopping = true;
+  }
+  readSpace.notify_all();
+  readWork.notify_all();
+  parseSpace.notify_all();
+  parseWork.notify_all();
+  for (auto &thread : threads)
+    thread.join();
+  threads.clear();
+  toRead.clear();
+  toParse.clear();
+}
+
+void MetadataPipeline::submit(ScannedTrack track) {
+  {
+    std::unique_lock<std::mutex> lock(queueLock);
+    readSpace.wait(lock,
+                   [&] { return stopping || toRead.size() < readCapacity; });
+    if (stopping)
+      return;
+    ++submitted;
+    toRead.push_back(std::move(track));
+  }
+  readWork.notify_one();
+}
+
+size_t MetadataPipeline::poll(std::vector<ScannedTrack> &out) {
+  std::lock_guard<std::mutex> lock(readyLock);
+  size_t count = ready.size();
+  out.insert(out.end(), std::make_move_iterator(ready.begin()),
+             std::make_move_iterator(ready.end()));
+  ready.clear();
+  return count;
+}
+
+PipelineProgress MetadataPipeline::getProgress() const {
+  PipelineProgress progress;
+  std::lock_guard<std::mutex> lock(queueLock);
+  progress.submitted = submitted.load();
+  progress.read = readCount;
+  progress.parsed = completed.load();
+  progress.rejected = rejected.load();
+  progress.bytesRead = bytesRead;
+  progress.readsInFlight = readsInFlight;
+  return progress;
+}
+
+void MetadataPipeline::readerLoop() {
+  for (;;) {
+    ParseJob job;
+    {
+      std::unique_lock<std::mutex> lock(queueLock);
+      readWork.wait(lock, [&] { return stopping || !toRead.empty(); });
+      if (stopping)
+        return;
+      job.track = std::move(toRead.front());
+      toRead.pop_front();
+      ++readsInFlight;
+    }
+    readSpace.notify_one();
+
+    job.readOk = readHeaders(job.track.path, job.headers);
+
+    {
+      std::unique_lock<std::mutex> lock(queueLock);
+      --readsInFlight;
+      ++readCount;
+      bytesRead += job.headers.bytes();
+      // Holding the buffers here, rather than reading ahead, is what
+      // bounds memory when parsing falls behind.
+      parseSpace.wait(
+          lock, [&] { return stopping || toParse.size() < parseCapacity; });
+      if (stopping)
+        return;
+      toParse.push_back(std::move(job));
+    }
+    parseWork.notify_one();
+  }
+}
+
+void MetadataPipeline::parserLoop() {
+  for (;;) {
+    ParseJob job;
+    {
+      std::unique_lock<std::mutex> lock(queueLock);
+      parseWork.wait(lock, [&] { return stopping || !toParse.empty(); });
+      if (stopping)
+        return;
+      job = std::move(toParse.front());
+      toParse.pop_front();
+    }
+    parseSpace.notify_one();
+
+    // A file that could not be read is still listed, just without a
+    // length or tags, as the probe always did. One that was read but is
+    // not audio the decoders accept is dropped, so it never fails to play.
+    if (job.readOk) {
+      parseHeaders(job.headers, job.track.meta.info, job.track.tags);
+      if (job.track.meta.info.format == AUDIO_UNKNOWN) {
+        ++rejected;
+        ++completed;
+        continue;
+      }
+    }
+    {
+      std::lock_guard<std::mutex> lock(readyLock);
+      ready.push_back(std::move(job.track));
+    }
+    ++completed;
+  }
+}
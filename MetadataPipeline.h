@@ -0,0 +1,115 @@
+#ifndef METADATA_PIPELINE_H
+#define METADATA_PIPELINE_H
+
+#include "Library.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// The bytes of a file that its duration and tags are parsed from, read in
+// one pass. The file is closed once they are read, so queued headers hold
+// no descriptors; a parser reopens it for tag frames past the head.
+struct FileHeaders {
+  std::string path;
+  uint64_t fileSize = 0;
+  std::vector<unsigned char> head;  // From offset 0, up to TAG_HEAD_BYTES
+  std::vector<unsigned char> audio; // Past an ID3v2 tag longer than head
+  uint64_t audioOffset = 0;         // Where the audio stream starts
+  std::vector<unsigned char> tail;  // Last bytes, for Ogg and ID3v1
+
+  size_t bytes() const { return head.size() + audio.size() + tail.size(); }
+};
+
+// I/O half: at most three preads. Returns false if path cannot be read.
+bool readHeaders(const std::string &path, FileHeaders &headers);
+// CPU half; only reopens the file for tag frames outside the buffers.
+void parseHeaders(const FileHeaders &headers, AudioProbeInfo &info,
+                  TrackTags &tags);
+// Both halves on the calling thread. Returns false if the file was read
+// and is not audio the decoders accept; one that cannot be read is kept,
+// with empty metadata.
+bool readMetadata(const std::string &path, AudioProbeInfo &info,
+                  TrackTags &tags);
+
+// Concurrent reads that suit the file system holding path: few for network
+// mounts, which degrade for everyone when flooded, more for local disks,
+// which need a deep queue to reach full speed.
+unsigned defaultIoDepth(const std::string &path);
+
+struct PipelineProgress {
+  size_t submitted = 0;
+  size_t read = 0;
+  size_t parsed = 0;
+  size_t rejected = 0; // Of those, dropped as not audio
+  uint64_t bytesRead = 0;
+  unsigned readsInFlight = 0;
+};
+
+// Reads and parses track metadata in stages connected by bounded queues:
+// submit() -> ioDepth reader threads -> parser threads -> poll(). The
+// readers bound the reads in flight; when a queue fills up the stage
+// before it blocks, so a slow disk holds back enumeration rather than
+// piling up paths and buffers.
+class MetadataPipeline {
+public:
+  // ioDepth 0 uses defaultIoDepth(root); parsers 0 uses one per core.
+  explicit MetadataPipeline(const std::string &root, unsigned ioDepth = 0,
+                            unsigned parsers = 0);
+  ~MetadataPipeline();
+  MetadataPipeline(const MetadataPipeline &) = delete;
+  MetadataPipeline &operator=(const MetadataPipeline &) = delete;
+
+  // Queues a track with size and mtime filled in. Blocks while the read
+  // queue is full; dropped after stop().
+  void submit(ScannedTrack track);
+  // Moves finished tracks to the end of out and returns how many.
+  size_t poll(std::vector<ScannedTrack> &out);
+  // True once every submitted track has been handed to poll's queue.
+  bool isIdle() const { return completed.load() == submitted.load(); }
+  // Wakes blocked submitters and joins the threads; pending work is lost.
+  void stop();
+
+  PipelineProgress getProgress() const;
+  unsigned getIoDepth() const { return ioDepth; }
+
+private:
+  struct ParseJob {
+    ScannedTrack track;
+    FileHeaders headers;
+    bool readOk;
+  };
+
+  void readerLoop();
+  void parserLoop();
+
+  unsigned ioDepth;
+  size_t readCapacity;
+  size_t parseCapacity;
+  std::vector<std::thread> threads;
+
+  mutable std::mutex queueLock;
+  std::condition_variable readSpace; // toRead shrank
+  std::condition_variable readWork;  // toRead grew
+  std::condition_variable parseSpace;
+  std::condition_variable parseWork;
+  std::deque<ScannedTrack> toRead;
+  std::deque<ParseJob> toParse;
+  bool stopping = false;
+  unsigned readsInFlight = 0;
+  size_t readCount = 0;
+  uint64_t bytesRead = 0;
+
+  std::atomic<size_t> submitted{0};
+  std::atomic<size_t> completed{0};
+  std::atomic<size_t> rejected{0};
+
+  std::mutex readyLock;
+  std::vector<ScannedTrack> ready;
+};
+
+#endif // METADATA_PIPELINE_H
@@ -0,0 +1,158 @@
+#include "MmapVfs.h"
+#include "VfsUtils.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <new>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct MappedFile {
+  const unsigned char *data;
+  size_t size;
+  size_t cursor;
+};
+
+static ma_result mmap_vfs_open(ma_vfs *pVFS, const char *pFilePath,
+                               ma_uint32 openMode, ma_vfs_file *pFile) {
+  (void)pVFS;
+  if (pFile == NULL)
+    return MA_INVALID_ARGS;
+  *pFile = NULL;
+
+  // Decoders only ever read
+  if ((openMode & MA_OPEN_MODE_WRITE) != 0)
+    return MA_NOT_IMPLEMENTED;
+
+  int fd = open(pFilePath, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return vfsResultFromErrno(errno);
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    int err = errno;
+    close(fd);
+    return vfsResultFromErrno(err);
+  }
+
+  void *data = NULL;
+  if (st.st_size > 0) {
+    data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+      int err = errno;
+      close(fd);
+      return vfsResultFromErrno(err);
+    }
+    madvise(data, (size_t)st.st_size, MADV_SEQUENTIAL);
+  }
+  // The mapping keeps the file alive
+  close(fd);
+
+  MappedFile *pMapped = new (std::nothrow) MappedFile;
+  if (pMapped == NULL) {
+    if (data != NULL)
+      munmap(data, (size_t)st.st_size);
+    return MA_OUT_OF_MEMORY;
+  }
+  pMapped->data = (const unsigned char *)data;
+  pMapped->size = (size_t)st.st_size;
+  pMapped->cursor = 0;
+  *pFile = pMapped;
+  return MA_SUCCESS;
+}
+
+static ma_result mmap_vfs_open_w(ma_vfs *pVFS, const wchar_t *pFilePath,
+                                 ma_uint32 openMode, ma_vfs_file *pFile) {
+  (void)pVFS;
+  (void)pFilePath;
+  (void)openMode;
+  (void)pFile;
+  return MA_NOT_IMPLEMENTED;
+}
+
+static ma_result mmap_vfs_close(ma_vfs *pVFS, ma_vfs_file file) {
+  (void)pVFS;
+  MappedFile *pMapped = (MappedFile *)file;
+  if (pMapped == NULL)
+    return MA_INVALID_ARGS;
+  if (pMapped->data != NULL)
+    munmap((void *)pMapped->data, pMapped->size);
+  delete pMapped;
+  return MA_SUCCESS;
+}
+
+// Mirrors the stdio VFS: short reads succeed, MA_AT_END only when nothing
+// is left.
+static ma_result mmap_vfs_read(ma_vfs *pVFS, ma_vfs_file file, void *pDst,
+                               size_t sizeInBytes, size_t *pBytesRead) {
+  (void)pVFS;
+  MappedFile *pMapped = (MappedFile *)file;
+  size_t available =
+      pMapped->cursor < pMapped->size ? pMapped->size - pMapped->cursor : 0;
+  size_t bytes = sizeInBytes < available ? sizeInBytes : available;
+
+  if (bytes > 0) {
+    memcpy(pDst, pMapped->data + pMapped->cursor, bytes);
+    pMapped->cursor += bytes;
+  }
+  if (pBytesRead != NULL)
+    *pBytesRead = bytes;
+
+  return (bytes == 0 && sizeInBytes > 0) ? MA_AT_END : MA_SUCCESS;
+}
+
+static ma_result mmap_vfs_write(ma_vfs *pVFS, ma_vfs_file file,
+                                const void *pSrc, size_t sizeInBytes,
+                                size_t *pBytesWritten) {
+  (void)pVFS;
+  (void)file;
+  (void)pSrc;
+  (void)sizeInBytes;
+  if (pBytesWritten != NULL)
+    *pBytesWritten = 0;
+  return MA_NOT_IMPLEMENTED;
+}
+
+static ma_result mmap_vfs_seek(ma_vfs *pVFS, ma_vfs_file file,
+                               ma_int64 offset, ma_seek_origin origin) {
+  (void)pVFS;
+  MappedFile *pMapped = (MappedFile *)file;
+  ma_int64 base = 0;
+  if (origin == ma_seek_origin_current)
+    base = (ma_int64)pMapped->cursor;
+  else if (origin == ma_seek_origin_end)
+    base = (ma_int64)pMapped->size;
+
+  if (base + offset < 0)
+    return MA_BAD_SEEK;
+  // Like fseek, seeking past the end is allowed; reads then hit MA_AT_END
+  pMapped->cursor = (size_t)(base + offset);
+  return MA_SUCCESS;
+}
+
+static ma_result mmap_vfs_tell(ma_vfs *pVFS, ma_vfs_file file,
+                               ma_int64 *pCursor) {
+  (void)pVFS;
+  *pCursor = (ma_int64)((MappedFile *)file)->cursor;
+  return MA_SUCCESS;
+}
+
+static ma_result mmap_vfs_info(ma_vfs *pVFS, ma_vfs_file file,
+                               ma_file_info *pInfo) {
+  (void)pVFS;
+  pInfo->sizeInBytes = ((MappedFile *)file)->size;
+  return MA_SUCCESS;
+}
+
+void mmapVfsInit(MmapVfs *pVfs) {
+  pVfs->cb.onOpen = mmap_vfs_open;
+  pVfs->cb.onOpenW = mmap_vfs_open_w;
+  pVfs->cb.onClose = mmap_vfs_close;
+  pVfs->cb.onRead = mmap_vfs_read;
+  pVfs->cb.onWrite = mmap_vfs_write;
+  pVfs->cb.onSeek = mmap_vfs_seek;
+  pVfs->cb.onTell = mmap_vfs_tell;
+  pVfs->cb.onInfo = mmap_vfs_info;
+}
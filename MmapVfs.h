@@ -0,0 +1,14 @@
+#ifndef MMAP_VFS_H
+#define MMAP_VFS_H
+
+#include "miniaudio.h"
+
+// Read-only ma_vfs backed by mmap. Reads are memcpy's out of the page cache
+// instead of one read syscall per fread, and seeking is just moving a cursor.
+struct MmapVfs {
+  ma_vfs_callbacks cb; // Must be first, miniaudio casts ma_vfs* to this
+};
+
+void mmapVfsInit(MmapVfs *pVfs);
+
+#endif // MMAP_VFS_H
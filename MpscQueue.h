@@ -0,0 +1,63 @@
+#ifndef MPSC_QUEUE_H
+#define MPSC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+// Bounded lock-free multi-producer single-consumer queue (Vyukov's
+// sequence-numbered ring). push() never blocks; it fails when full.
+// Capacity must be a power of two.
+template <typename T, size_t Capacity> class MpscQueue {
+  static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0,
+                "Capacity must be a power of two");
+
+  struct Cell {
+    std::atomic<size_t> sequence;
+    T value;
+  };
+
+  Cell cells[Capacity];
+  alignas(64) std::atomic<size_t> enqueuePos{0};
+  alignas(64) size_t dequeuePos = 0; // Consumer only
+
+public:
+  MpscQueue() {
+    for (size_t i = 0; i < Capacity; ++i)
+      cells[i].sequence.store(i, std::memory_order_relaxed);
+  }
+
+  bool push(T value) {
+    size_t pos = enqueuePos.load(std::memory_order_relaxed);
+    Cell *pCell;
+    for (;;) {
+      pCell = &cells[pos & (Capacity - 1)];
+      size_t seq = pCell->sequence.load(std::memory_order_acquire);
+      if (seq == pos) {
+        if (enqueuePos.compare_exchange_weak(pos, pos + 1,
+                                             std::memory_order_relaxed))
+          break;
+      } else if (seq < pos) {
+        return false; // Full
+      } else {
+        pos = enqueuePos.load(std::memory_order_relaxed);
+      }
+    }
+    pCell->value = std::move(value);
+    pCell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool pop(T &out) {
+    Cell *pCell = &cells[dequeuePos & (Capacity - 1)];
+    size_t seq = pCell->sequence.load(std::memory_order_acquire);
+    if (seq != dequeuePos + 1)
+      return false; // Empty, or the producer has not finished writing
+    out = std::move(pCell->value);
+    pCell->sequence.store(dequeuePos + Capacity, std::memory_order_release);
+    ++dequeuePos;
+    return true;
+  }
+};
+
+#endif // MPSC_QUEUE_H
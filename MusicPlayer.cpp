@@ -1,15 +1,117 @@
 #define MINIAUDIO_IMPLEMENTATION
 #include "MusicPlayer.h"
+#include "RtGuard.h"
 #include <algorithm>
+#include <chrono>
 #include <iostream>
+#include <thread>
+
+// We own the device so we can pick period size, period count, performance
+// profile and share mode. The engine only mixes; this pulls from it.
+void TermMusicPlayer::dataCallback(ma_device *pDevice, void *pOutput,
+                                   const void *pInput, ma_uint32 frameCount) {
+  (void)pInput;
+  RT_GUARD_SCOPE();
+  TermMusicPlayer *pPlayer = (TermMusicPlayer *)pDevice->pUserData;
+
+  auto start = std::chrono::steady_clock::now();
+  ma_engine_read_pcm_frames(&pPlayer->engine, pOutput, frameCount, NULL);
+  auto end = std::chrono::steady_clock::now();
+  ma_uint64 ns =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+
+  DeviceClock clock;
+  clock.engineFrames = ma_engine_get_time_in_pcm_frames(&pPlayer->engine);
+  clock.timeNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                     end.time_since_epoch())
+                     .count();
+  pPlayer->deviceClock.store(clock);
+
+  // Single writer, so plain load/store is enough
+  pPlayer->callbackCount.store(
+      pPlayer->callbackCount.load(std::memory_order_relaxed) + 1,
+      std::memory_order_relaxed);
+  pPlayer->callbackNs.store(
+      pPlayer->callbackNs.load(std::memory_order_relaxed) + ns,
+      std::memory_order_relaxed);
+  if (ns > pPlayer->callbackMaxNs.load(std::memory_order_relaxed))
+    pPlayer->callbackMaxNs.store(ns, std::memory_order_relaxed);
+}
+
+bool TermMusicPlayer::initDevice(const AudioConfig &config,
+                                 ma_share_mode shareMode) {
+  ma_device_config deviceConfig = ma_device_config_init(ma_device_type_playback);
+  deviceConfig.playback.format = ma_format_f32;
+  deviceConfig.playback.channels = 0;  // Native
+  deviceConfig.playback.shareMode = shareMode;
+  deviceConfig.sampleRate = 0;         // Native
+  deviceConfig.periodSizeInFrames = config.periodSizeInFrames;
+  deviceConfig.periods = config.periods;
+  deviceConfig.performanceProfile = config.lowLatency
+                                        ? ma_performance_profile_low_latency
+                                        : ma_performance_profile_conservative;
+  deviceConfig.dataCallback = dataCallback;
+  deviceConfig.pUserData = this;
+  // Same as the engine's own device: it writes every frame and clips itself
+  deviceConfig.noPreSilencedOutputBuffer = MA_TRUE;
+  deviceConfig.noClip = MA_TRUE;
 
-TermMusicPlayer::TermMusicPlayer() {
   ma_result result;
+  if (config.nullBackend) {
+    ma_backend backend = ma_backend_null;
+    result = ma_device_init_ex(&backend, 1, NULL, &deviceConfig, &device);
+  } else {
+    result = ma_device_init(NULL, &deviceConfig, &device);
+  }
+  if (result != MA_SUCCESS) {
+    std::cerr << "Device init failed with error: " << result << std::endl;
+    return false;
+  }
+  return true;
+}
+
+TermMusicPlayer::TermMusicPlayer(const AudioConfig &config)
+    : allocationCallbacks(allocator.callbacks()), ioMode(config.ioMode) {
+  ma_result result;
+  AllocScope allocScope(ALLOC_ENGINE);
   // Zero init array
   for (int i = 0; i < NUM_BARS; ++i)
     visNode.bars[i] = 0.0f;
 
-  if ((result = ma_engine_init(NULL, &engine)) == MA_SUCCESS) {
+  ma_engine_config engineConfig = ma_engine_config_init();
+  engineConfig.allocationCallbacks = allocationCallbacks;
+
+  if (ioMode == IO_MMAP) {
+    mmapVfsInit(&mmapVfs);
+    engineConfig.pResourceManagerVFS = &mmapVfs;
+  } else if (ioMode == IO_READAHEAD) {
+    readAheadVfsInit(&readAheadVfs, config.readAheadBlockSize,
+                     config.readAheadDepth);
+    engineConfig.pResourceManagerVFS = &readAheadVfs;
+  }
+
+  if (config.noDevice) {
+    // Offline: the caller pulls frames with readFrames()
+    engineConfig.noDevice = MA_TRUE;
+    engineConfig.channels = config.channels ? config.channels : 2;
+    engineConfig.sampleRate = config.sampleRate ? config.sampleRate : 48000;
+    engineConfig.periodSizeInFrames = config.periodSizeInFrames;
+  } else {
+    deviceInitialized = initDevice(config, config.exclusive
+                                               ? ma_share_mode_exclusive
+                                               : ma_share_mode_shared);
+    if (!deviceInitialized && config.exclusive) {
+      std::cerr << "Exclusive mode unavailable, falling back to shared."
+                << std::endl;
+      deviceInitialized = initDevice(config, ma_share_mode_shared);
+    }
+    if (!deviceInitialized)
+      return;
+
+    engineConfig.pDevice = &device;
+  }
+
+  if ((result = ma_engine_init(&engineConfig, &engine)) == MA_SUCCESS) {
     // Init Visualizer Node
     ma_node_config nodeConfig = ma_node_config_init();
     nodeConfig.vtable = &g_visualizer_vtable;
@@ -21,8 +123,8 @@ TermMusicPlayer::TermMusicPlayer() {
 
     ma_node_graph *pGraph = &engine.nodeGraph;
 
-    if ((result = ma_node_init(pGraph, &nodeConfig, NULL, &visNode.base)) ==
-        MA_SUCCESS) {
+    if ((result = ma_node_init(pGraph, &nodeConfig, &allocationCallbacks,
+                               &visNode.base)) == MA_SUCCESS) {
       // Attach VisNode output to Engine Endpoint
       ma_node_attach_output_bus(&visNode.base, 0,
                                 ma_node_graph_get_endpoint(pGraph), 0);
@@ -31,12 +133,19 @@ TermMusicPlayer::TermMusicPlayer() {
       std::cerr << "Visualizer node init failed with error: " << result
                 << std::endl;
       initialized = false;
+      ma_engine_uninit(&engine);
+      if (deviceInitialized)
+        ma_device_uninit(&device);
+      deviceInitialized = false;
     }
 
     if (initialized)
       ma_engine_set_volume(&engine, currentVolume);
   } else {
     std::cerr << "Engine init failed with error: " << result << std::endl;
+    if (deviceInitialized)
+      ma_device_uninit(&device);
+    deviceInitialized = false;
   }
 }
 
@@ -45,8 +154,14 @@ TermMusicPlayer::~TermMusicPlayer() {
     ma_sound_uninit(&sound);
 
   if (initialized) {
-    ma_node_uninit(&visNode.base, NULL);
+    // The engine does not own the device; stop callbacks before tearing down
+    // the graph they read from.
+    if (deviceInitialized)
+      ma_device_stop(&device);
+    ma_node_uninit(&visNode.base, &allocationCallbacks);
     ma_engine_uninit(&engine);
+    if (deviceInitialized)
+      ma_device_uninit(&device);
   }
 }
 
@@ -54,21 +169,39 @@ bool TermMusicPlayer::play(const std::string &path) {
   if (!initialized)
     return false;
 
+  AllocScope allocScope(ALLOC_TRACK);
   if (soundLoaded) {
     ma_sound_stop(&sound);
     ma_sound_uninit(&sound);
     soundLoaded = false;
   }
+  allocator.beginTrack();
 
   // MA_SOUND_FLAG_NO_DEFAULT_ATTACHMENT because we want to attach to our
   // custom node manually
-  if (ma_sound_init_from_file(&engine, path.c_str(),
-                              MA_SOUND_FLAG_NO_DEFAULT_ATTACHMENT, NULL, NULL,
+  ma_uint32 flags = MA_SOUND_FLAG_NO_DEFAULT_ATTACHMENT;
+  // The resource manager already decodes at the engine rate and pitch is
+  // never changed. With pitch enabled, the engine node's linear resampler
+  // runs even at a 1:1 ratio and delays the track by one frame.
+  flags |= MA_SOUND_FLAG_NO_PITCH;
+  // Otherwise the whole file is read up front and read-ahead has nothing to
+  // hide; streaming decodes from the VFS as playback advances.
+  if (ioMode == IO_READAHEAD)
+    flags |= MA_SOUND_FLAG_STREAM;
+
+  if (ma_sound_init_from_file(&engine, path.c_str(), flags, NULL, NULL,
                               &sound) == MA_SUCCESS) {
 
     // Attach Sound -> Visualizer Node
     ma_node_attach_output_bus(&sound, 0, &visNode.base, 0);
 
+    // Length can mean a full scan for some formats; do it once per track
+    lengthFrames = 0;
+    ma_sound_get_length_in_pcm_frames(&sound, &lengthFrames);
+    if (ma_sound_get_data_format(&sound, NULL, NULL, &soundSampleRate, NULL,
+                                 0) != MA_SUCCESS)
+      soundSampleRate = ma_engine_get_sample_rate(&engine);
+
     ma_sound_start(&sound);
     soundLoaded = true;
     currentFile = path;
@@ -118,12 +251,8 @@ void TermMusicPlayer::seekBy(float delta) {
   float length = getLength();
   float target = std::min(std::max(current + delta, 0.0f), length);
 
-  ma_uint32 sampleRate;
-  if (ma_sound_get_data_format(&sound, NULL, NULL, &sampleRate, NULL, 0) ==
-      MA_SUCCESS) {
-    ma_uint64 frame = (ma_uint64)(target * sampleRate);
-    ma_sound_seek_to_pcm_frame(&sound, frame);
-  }
+  ma_uint64 frame = (ma_uint64)(target * soundSampleRate);
+  ma_sound_seek_to_pcm_frame(&sound, frame);
 
   if (wasPlaying) {
     ma_sound_start(&sound);
@@ -152,10 +281,124 @@ float TermMusicPlayer::getCursor() {
 }
 
 float TermMusicPlayer::getLength() {
-  float length = 0.0f;
+  if (!soundLoaded || soundSampleRate == 0)
+    return 0.0f;
+  return (float)lengthFrames / soundSampleRate;
+}
+
+ma_uint64 TermMusicPlayer::getCursorInFrames() {
+  ma_uint64 cursor = 0;
   if (soundLoaded)
-    ma_sound_get_length_in_seconds(&sound, &length);
-  return length;
+    ma_sound_get_cursor_in_pcm_frames(&sound, &cursor);
+  return cursor;
+}
+
+ma_uint32 TermMusicPlayer::getSoundSampleRate() const {
+  return soundLoaded ? soundSampleRate : 0;
+}
+
+bool TermMusicPlayer::isAtEnd() const {
+  return soundLoaded && ma_sound_at_end(&sound);
+}
+
+ma_uint64 TermMusicPlayer::getLengthInFrames() const {
+  return soundLoaded ? lengthFrames : 0;
+}
+
+ma_uint64 TermMusicPlayer::readFrames(float *pFrames, ma_uint64 frameCount) {
+  // Stands in for the device callback, so it is held to the same rules
+  RT_GUARD_SCOPE();
+  ma_uint64 framesRead = 0;
+  if (initialized && !deviceInitialized)
+    ma_engine_read_pcm_frames(&engine, pFrames, frameCount, &framesRead);
+  return framesRead;
+}
+
+bool TermMusicPlayer::waitForFrames(ma_uint64 frameCount) {
+  if (!soundLoaded || ioMode != IO_READAHEAD)
+    return true;
+  ma_resource_manager_data_source *pSource =
+      (ma_resource_manager_data_source *)ma_sound_get_data_source(&sound);
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  for (;;) {
+    ma_uint64 available = 0, cursor = 0;
+    ma_resource_manager_data_source_get_available_frames(pSource, &available);
+    ma_sound_get_cursor_in_pcm_frames(&sound, &cursor);
+    if (available >= frameCount || cursor + available >= lengthFrames ||
+        ma_sound_at_end(&sound))
+      return true;
+    if (std::chrono::steady_clock::now() > deadline)
+      return false;
+    std::this_thread::sleep_for(std::chrono::microseconds(200));
+  }
+}
+
+ma_uint32 TermMusicPlayer::getPeriodSizeInFrames() const {
+  return deviceInitialized ? device.playback.internalPeriodSizeInFrames : 0;
+}
+
+ma_uint32 TermMusicPlayer::getPeriods() const {
+  return deviceInitialized ? device.playback.internalPeriods : 0;
+}
+
+ma_uint32 TermMusicPlayer::getChannels() const {
+  return initialized ? ma_engine_get_channels(&engine) : 0;
+}
+
+ma_uint32 TermMusicPlayer::getSampleRate() const {
+  if (deviceInitialized)
+    return device.playback.internalSampleRate;
+  return initialized ? ma_engine_get_sample_rate(&engine) : 0;
+}
+
+bool TermMusicPlayer::isExclusive() const {
+  return deviceInitialized &&
+         device.playback.shareMode == ma_share_mode_exclusive;
+}
+
+float TermMusicPlayer::getLatencyMs() const {
+  ma_uint32 sampleRate = getSampleRate();
+  if (sampleRate == 0)
+    return 0.0f;
+  return 1000.0f * getOutputLatencyFrames() / sampleRate;
+}
+
+// miniaudio has no portable latency query; the whole device buffer is
+// queued ahead of what is being heard, so use that.
+ma_uint32 TermMusicPlayer::getOutputLatencyFrames() const {
+  return getPeriodSizeInFrames() * getPeriods();
+}
+
+DeviceClock TermMusicPlayer::getDeviceClock() const {
+  return deviceClock.load();
+}
+
+ma_uint64 TermMusicPlayer::getEngineTimeInFrames() const {
+  return initialized ? ma_engine_get_time_in_pcm_frames(&engine) : 0;
+}
+
+CallbackStats TermMusicPlayer::getCallbackStats() const {
+  CallbackStats stats;
+  stats.callbacks = callbackCount.load(std::memory_order_relaxed);
+  stats.totalNs = callbackNs.load(std::memory_order_relaxed);
+  stats.maxNs = callbackMaxNs.load(std::memory_order_relaxed);
+  return stats;
+}
+
+FileIoMode TermMusicPlayer::getIoMode() const { return ioMode; }
+
+ReadAheadStats TermMusicPlayer::getReadAheadStats() const {
+  if (ioMode != IO_READAHEAD)
+    return ReadAheadStats();
+  return readAheadVfsGetStats(&readAheadVfs);
+}
+
+AllocStats TermMusicPlayer::getAllocStats() const {
+  return allocator.getStats();
+}
+
+uint32_t TermMusicPlayer::getVisSequence() const {
+  return visNode.sequence.load(std::memory_order_acquire);
 }
 
 void TermMusicPlayer::getVisData(std::vector<float> &outBars) {
@@ -1,25 +1,88 @@
 #ifndef MUSIC_PLAYER_H
 #define MUSIC_PLAYER_H
 
+#include "MmapVfs.h"
+#include "PoolAllocator.h"
+#include "ReadAheadVfs.h"
+#include "SeqLock.h"
 #include "VisualizerNode.h"
 #include "miniaudio.h"
+#include <atomic>
 #include <string>
 #include <vector>
 
+// How decoders read files
+enum FileIoMode {
+  IO_STDIO, // miniaudio's default VFS
+  IO_MMAP,     // MmapVfs
+  IO_READAHEAD // ReadAheadVfs, sounds are streamed instead of preloaded
+};
+
+// Playback device tuning. Zero values leave the choice to miniaudio.
+struct AudioConfig {
+  ma_uint32 periodSizeInFrames = 0;
+  ma_uint32 periods = 0;
+  bool lowLatency = false; // ma_performance_profile_low_latency
+  bool exclusive = false;  // Exclusive share mode, falls back to shared
+  bool nullBackend = false; // miniaudio's null backend (benchmarks, CI)
+  FileIoMode ioMode = IO_MMAP;
+  int readAheadDepth = 16;               // Blocks kept ahead of the decoder
+  size_t readAheadBlockSize = 256 * 1024; // Bytes per block
+
+  // Offline rendering: no device, frames are pulled with readFrames()
+  bool noDevice = false;
+  ma_uint32 channels = 0;   // Default 2 when noDevice
+  ma_uint32 sampleRate = 0; // Default 48000 when noDevice
+};
+
+// Cost of the device data callback, i.e. one pull through the node graph
+struct CallbackStats {
+  ma_uint64 callbacks = 0;
+  ma_uint64 totalNs = 0;
+  ma_uint64 maxNs = 0;
+};
+
+// Where the engine was at the end of the last device callback
+struct DeviceClock {
+  ma_uint64 engineFrames = 0; // Engine time after the callback's read
+  ma_int64 timeNs = 0;        // steady_clock, 0 before the first callback
+};
+
 class TermMusicPlayer {
+  // Declared first so it outlives everything that allocates from it
+  PoolAllocator allocator;
+  ma_allocation_callbacks allocationCallbacks;
+
+  ma_device device;
   ma_engine engine;
   ma_sound sound;
+  MmapVfs mmapVfs;
+  ReadAheadVfs readAheadVfs;
+  FileIoMode ioMode;
 
   // Visualization
   VisualizerNode visNode;
 
+  bool deviceInitialized = false;
   bool initialized = false;
   bool soundLoaded = false;
   std::string currentFile;
   float currentVolume = 1.0f;
+  ma_uint64 lengthFrames = 0;    // Cached at load
+  ma_uint32 soundSampleRate = 0; // Rate the cursor and length are in
+
+  // Written by the audio thread only
+  std::atomic<ma_uint64> callbackCount{0};
+  std::atomic<ma_uint64> callbackNs{0};
+  std::atomic<ma_uint64> callbackMaxNs{0};
+  SeqLock<DeviceClock> deviceClock;
+
+  static void dataCallback(ma_device *pDevice, void *pOutput,
+                           const void *pInput, ma_uint32 frameCount);
+  bool initDevice(const AudioConfig &config, ma_share_mode shareMode);
 
 public:
-  TermMusicPlayer();
+  TermMusicPlayer(const AudioConfig &config = AudioConfig());
   ~TermMusicPlayer();
 
   bool play(const std::string &path);
@@ -35,9 +98,42 @@ public:
   float getVolume() const;
   float getCursor();
   float getLength();
+  ma_uint64 getCursorInFrames();
+  ma_uint64 getLengthInFrames() const;
+  ma_uint32 getSoundSampleRate() const;
+  bool isAtEnd() const;
+
+  // Offline only: pulls frames through the node graph
+  ma_uint64 readFrames(float *pFrames, ma_uint64 frameCount);
+  // Offline only: a streamed sound is decoded by the resource manager's
+  // job thread, which a faster-than-realtime pull can overtake, and the
+  // engine then mixes silence. Waits until frameCount frames (or the rest
+  // of the track) are decoded. Returns false if none arrive for a while.
+  bool waitForFrames(ma_uint64 frameCount);
+
+  // Everything below only reads atomics or fields fixed at construction,
+  // so it is safe from any thread. The methods above are not thread-safe;
+  // drive them through a PlayerController.
+
+  // Device Info (what the backend actually granted)
+  ma_uint32 getPeriodSizeInFrames() const;
+  ma_uint32 getPeriods() const;
+  ma_uint32 getChannels() const;
+  ma_uint32 getSampleRate() const;
+  bool isExclusive() const;
+  float getLatencyMs() const;
+  ma_uint32 getOutputLatencyFrames() const;
+  DeviceClock getDeviceClock() const;
+  ma_uint64 getEngineTimeInFrames() const;
+  CallbackStats getCallbackStats() const;
+  FileIoMode getIoMode() const;
+  ReadAheadStats getReadAheadStats() const;
+  AllocStats getAllocStats() const;
 
   // Vis Data
   void getVisData(std::vector<float> &outBars);
+  // Changes whenever getVisData() would return new bars
+  uint32_t getVisSequence() const;
 };
 
 #endif // MUSIC_PLAYER_H
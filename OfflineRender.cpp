@@ -0,0 +1,95 @@
+#include "OfflineRender.h"
+#include "MusicPlayer.h"
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <vector>
+
+// Render at the source's native format so the output is bit-for-bit
+// reproducible and free of resampling.
+static bool getNativeFormat(const std::string &path, ma_uint32 &channels,
+                            ma_uint32 &sampleRate) {
+  ma_decoder decoder;
+  if (ma_decoder_init_file(path.c_str(), NULL, &decoder) != MA_SUCCESS)
+    return false;
+  ma_result result = ma_decoder_get_data_format(&decoder, NULL, &channels,
+                                                &sampleRate, NULL, 0);
+  ma_decoder_uninit(&decoder);
+  return result == MA_SUCCESS;
+}
+
+int renderToFile(const std::string &inPath, const std::string &outPath,
+                 const AudioConfig &deviceConfig) {
+  AudioConfig config;
+  config.noDevice = true;
+  config.ioMode = deviceConfig.ioMode;
+  config.readAheadDepth = deviceConfig.readAheadDepth;
+  config.readAheadBlockSize = deviceConfig.readAheadBlockSize;
+  config.periodSizeInFrames = deviceConfig.periodSizeInFrames;
+  if (!getNativeFormat(inPath, config.channels, config.sampleRate)) {
+    std::cerr << "Cannot open " << inPath << std::endl;
+    return 1;
+  }
+
+  TermMusicPlayer player(config);
+  if (!player.isInit()) {
+    std::cerr << "Failed to initialize audio engine." << std::endl;
+    return 1;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+
+  if (!player.play(inPath)) {
+    std::cerr << "Cannot decode " << inPath << std::endl;
+    return 1;
+  }
+
+  ma_uint32 channels = player.getChannels();
+  ma_uint32 sampleRate = player.getSampleRate();
+  ma_encoder_config encoderConfig = ma_encoder_config_init(
+      ma_encoding_format_wav, ma_format_f32, channels, sampleRate);
+  ma_encoder encoder;
+  if (ma_encoder_init_file(outPath.c_str(), &encoderConfig, &encoder) !=
+      MA_SUCCESS) {
+    std::cerr << "Cannot write " << outPath << std::endl;
+    return 1;
+  }
+
+  // The sound and engine share a sample rate, so the sound length is also
+  // the number of engine frames to emit. The last read past the end is
+  // zero padded by the engine, so trim it.
+  const ma_uint64 totalFrames = player.getLengthInFrames();
+  const ma_uint64 chunkFrames =
+      config.periodSizeInFrames ? config.periodSizeInFrames : 1024;
+  std::vector<float> chunk(chunkFrames * channels);
+  ma_uint64 written = 0;
+
+  while (written < totalFrames) {
+    if (!player.waitForFrames(chunkFrames)) {
+      std::cerr << "Timed out decoding " << inPath << std::endl;
+      ma_encoder_uninit(&encoder);
+      return 1;
+    }
+    ma_uint64 frames = player.readFrames(chunk.data(), chunkFrames);
+    if (frames == 0)
+      break;
+    if (frames > totalFrames - written)
+      frames = totalFrames - written;
+    ma_encoder_write_pcm_frames(&encoder, chunk.data(), frames, NULL);
+    written += frames;
+    if (player.isAtEnd())
+      break;
+  }
+
+  ma_encoder_uninit(&encoder);
+
+  double elapsed = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  double audioSeconds = (double)written / sampleRate;
+  printf("Rendered %llu frames (%.2f s, %u ch @ %u Hz) in %.3f s: %.1fx "
+         "realtime\n",
+         (unsigned long long)written, audioSeconds, channels, sampleRate,
+         elapsed, elapsed > 0.0 ? audioSeconds / elapsed : 0.0);
+  return 0;
+}
@@ -0,0 +1,16 @@
+#ifndef OFFLINE_RENDER_H
+#define OFFLINE_RENDER_H
+
+#include "MusicPlayer.h"
+#include <string>
+
+// Decodes inPath through the same node graph used for playback (sound ->
+// VisualizerNode -> endpoint) without an audio device, as fast as the CPU
+// allows, and writes the result to outPath as a 32-bit float WAV. The file
+// is read with config's I/O mode and read-ahead settings, and the graph is
+// pulled in chunks of config's period size (1024 frames if unset). Prints
+// throughput in x-realtime. Returns a process exit code.
+int renderToFile(const std::string &inPath, const std::string &outPath,
+                 const AudioConfig &config);
+
+#endif // OFFLINE_RENDER_H
@@ -0,0 +1,197 @@
+#include "PathTable.h"
+#include <cstring>
+
+PathTable::PathTable() : dirSlots(64, 0), fileSlots(64, 0) {
+  Node root = {addName("", 0), NO_DIRECTORY, 0};
+  dirs.push_back(root);
+}
+
+uint32_t PathTable::addName(const char *name, size_t length) {
+  uint32_t offset = (uint32_t)arena.size();
+  arena.insert(arena.end(), name, name + length);
+  arena.push_back('\0');
+  return offset;
+}
+
+size_t PathTable::hashKey(uint32_t parent, const char *name, size_t length) {
+  // FNV-1a over the name, seeded with the parent id.
+  uint64_t hash = 14695981039346656037ull ^ (parent * 0x9E3779B97F4A7C15ull);
+  for (size_t i = 0; i < length; ++i) {
+    hash ^= (unsigned char)name[i];
+    hash *= 1099511628211ull;
+  }
+  return (size_t)(hash ^ (hash >> 32));
+}
+
+uint32_t PathTable::findNode(const std::vector<uint32_t> &slots,
+                             const std::vector<Node> &nodes, uint32_t parent,
+                             const char *name, size_t length,
+                             size_t &slot) const {
+  size_t mask = slots.size() - 1;
+  for (slot = hashKey(parent, name, length) & mask; slots[slot];
+       slot = (slot + 1) & mask) {
+    const Node &node = nodes[slots[slot] - 1];
+    const char *stored = arena.data() + node.name;
+    if (node.parent == parent && strncmp(stored, name, length) == 0 &&
+        stored[length] == '\0')
+      return slots[slot] - 1;
+  }
+  return NO_TRACK;
+}
+
+void PathTable::rehash(std::vector<uint32_t> &slots,
+                       const std::vector<Node> &nodes) {
+  std::vector<uint32_t> grown(slots.size() * 2, 0);
+  size_t mask = grown.size() - 1;
+  for (uint32_t id = 0; id < nodes.size(); ++id) {
+    const char *name = arena.data() + nodes[id].name;
+    size_t slot = hashKey(nodes[id].parent, name, strlen(name)) & mask;
+    while (grown[slot])
+      slot = (slot + 1) & mask;
+    grown[slot] = id + 1;
+  }
+  slots.swap(grown);
+}
+
+uint32_t PathTable::addNode(std::vector<uint32_t> &slots,
+                            std::vector<Node> &nodes, uint32_t parent,
+                            uint32_t depth, const char *name, size_t length) {
+  size_t slot;
+  uint32_t id = findNode(slots, nodes, parent, name, length, slot);
+  if (id != NO_TRACK)
+    return id;
+  // Keep the load factor under one half.
+  if ((nodes.size() + 1) * 2 > slots.size()) {
+    rehash(slots, nodes);
+    findNode(slots, nodes, parent, name, length, slot);
+  }
+  id = (uint32_t)nodes.size();
+  Node node = {addName(name, length), parent, depth};
+  nodes.push_back(node);
+  slots[slot] = id + 1;
+  return id;
+}
+
+uint32_t PathTable::walkDirectory(const std::string &path, size_t end) const {
+  uint32_t dir = 0;
+  size_t start = 0;
+  while (start < end) {
+    size_t slash = path.find('/', start);
+    if (slash == std::string::npos || slash > end)
+      slash = end;
+    size_t slot;
+    dir = findNode(dirSlots, dirs, dir, path.data() + start, slash - start,
+                   slot);
+    if (dir == NO_TRACK)
+      return NO_DIRECTORY;
+    start = slash + 1;
+  }
+  return dir;
+}
+
+uint32_t PathTable::internDirectory(const std::string &path, size_t end) {
+  uint32_t dir = 0;
+  size_t start = 0;
+  while (start < end) {
+    size_t slash = path.find('/', start);
+    if (slash == std::string::npos || slash > end)
+      slash = end;
+    uint32_t depth = dirs[dir].depth + 1;
+    dir = addNode(dirSlots, dirs, dir, depth, path.data() + start,
+                  slash - start);
+    start = slash + 1;
+  }
+  return dir;
+}
+
+TrackId PathTable::intern(const std::string &path) {
+  size_t slash = path.rfind('/');
+  size_t nameStart = slash == std::string::npos ? 0 : slash + 1;
+  uint32_t dir = 0;
+  if (slash != std::string::npos) {
+    // Paths arrive grouped by directory (scanner batches, the index in
+    // path order), so the previous directory usually matches.
+    if (slash == lastDirectory.size() &&
+        path.compare(0, slash, lastDirectory) == 0) {
+      dir = lastDirectoryId;
+    } else {
+      dir = internDirectory(path, slash);
+      lastDirectory.assign(path, 0, slash);
+      lastDirectoryId = dir;
+    }
+  }
+  return addNode(fileSlots, files, dir, 0, path.data() + nameStart,
+                 path.size() - nameStart);
+}
+
+TrackId PathTable::find(const std::string &path) const {
+  size_t slash = path.rfind('/');
+  size_t nameStart = slash == std::string::npos ? 0 : slash + 1;
+  uint32_t dir = slash == std::string::npos ? 0 : walkDirectory(path, slash);
+  if (dir == NO_DIRECTORY)
+    return NO_TRACK;
+  size_t slot;
+  return findNode(fileSlots, files, dir, path.data() + nameStart,
+                  path.size() - nameStart, slot);
+}
+
+uint32_t PathTable::findDirectory(const std::string &path) const {
+  return walkDirectory(path, path.size());
+}
+
+void PathTable::appendDirectory(uint32_t dir, std::string &out) const {
+  if (dir == 0)
+    return;
+  appendDirectory(dirs[dir].parent, out);
+  out += arena.data() + dirs[dir].name;
+  out += '/';
+}
+
+void PathTable::appendPath(TrackId id, std::string &out) const {
+  appendDirectory(files[id].parent, out);
+  out += arena.data() + files[id].name;
+}
+
+std::string PathTable::path(TrackId id) const {
+  std::string out;
+  appendPath(id, out);
+  return out;
+}
+
+bool PathTable::isUnder(TrackId id, uint32_t dir) const {
+  for (uint32_t d = files[id].parent; d != NO_DIRECTORY; d = dirs[d].parent)
+    if (d == dir)
+      return true;
+  return false;
+}
+
+bool PathTable::less(TrackId a, TrackId b) const {
+  uint32_t da = files[a].parent;
+  uint32_t db = files[b].parent;
+  const char *na = arena.data() + files[a].name;
+  const char *nb = arena.data() + files[b].name;
+  if (da != db) {
+    // Climb to the common ancestor, remembering the component of each path
+    // just below it; those are the first components that differ.
+    while (dirs[da].depth > dirs[db].depth) {
+      na = arena.data() + dirs[da].name;
+      da = dirs[da].parent;
+    }
+    while (dirs[db].depth > dirs[da].depth) {
+      nb = arena.data() + dirs[db].name;
+      db = dirs[db].parent;
+    }
+    while (da != db) {
+      na = arena.data() + dirs[da].name;
+      nb = arena.data() + dirs[db].name;
+      da = dirs[da].parent;
+      db = dirs[db].parent;
+    }
+  }
+  return strcmp(na, nb) < 0;
+}
+
+size_t PathTable::memoryBytes() const {
+  return arena.capacity() + (dirs.capacity() + files.capacity()) * sizeof(Node) +
+         (dirSlots.capacity() + fileSlots.capacity()) * sizeof(uint32_t);
+}
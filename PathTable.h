@@ -0,0 +1,74 @@
+#ifndef PATH_TABLE_H
+#define PATH_TABLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Stable index of an interned file path. Ids are dense, start at 0 and are
+// never reused, so they can key the queue, history and caches.
+typedef uint32_t TrackId;
+const TrackId NO_TRACK = 0xFFFFFFFFu;
+const uint32_t NO_DIRECTORY = 0xFFFFFFFFu;
+
+// Interned relative paths stored as a tree: every directory and file is a
+// node holding its parent's id and a 32-bit offset of its own name in one
+// shared character arena, so a directory prefix is stored once no matter
+// how many files it holds. Lookups go through open-addressed hash tables
+// keyed by (parent, name). Not thread-safe.
+class PathTable {
+public:
+  PathTable();
+
+  // Returns the id of path, adding it (and its directories) if needed.
+  TrackId intern(const std::string &path);
+  TrackId find(const std::string &path) const;
+  uint32_t findDirectory(const std::string &path) const;
+
+  size_t size() const { return files.size(); }
+  std::string path(TrackId id) const;
+  void appendPath(TrackId id, std::string &out) const;
+  const char *fileName(TrackId id) const {
+    return arena.data() + files[id].name;
+  }
+  bool isUnder(TrackId id, uint32_t dir) const;
+
+  // Orders by path component, so every directory's files stay together.
+  bool less(TrackId a, TrackId b) const;
+
+  size_t memoryBytes() const;
+
+private:
+  struct Node {
+    uint32_t name; // Offset into arena
+    uint32_t parent;
+    uint32_t depth; // Directories only; root is 0
+  };
+
+  uint32_t addName(const char *name, size_t length);
+  static size_t hashKey(uint32_t parent, const char *name, size_t length);
+  uint32_t findNode(const std::vector<uint32_t> &slots,
+                    const std::vector<Node> &nodes, uint32_t parent,
+                    const char *name, size_t length, size_t &slot) const;
+  uint32_t addNode(std::vector<uint32_t> &slots, std::vector<Node> &nodes,
+                   uint32_t parent, uint32_t depth, const char *name,
+                   size_t length);
+  void rehash(std::vector<uint32_t> &slots, const std::vector<Node> &nodes);
+  // Directory named by path[0, end); walk returns NO_DIRECTORY for unknown
+  // ones, intern adds them.
+  uint32_t walkDirectory(const std::string &path, size_t end) const;
+  uint32_t internDirectory(const std::string &path, size_t end);
+  void appendDirectory(uint32_t dir, std::string &out) const;
+
+  std::vector<char> arena;
+  std::vector<Node> dirs; // dirs[0] is the root
+  std::vector<Node> files;
+  // Open addressing with linear probing; slots hold id + 1, 0 is empty.
+  std::vector<uint32_t> dirSlots;
+  std::vector<uint32_t> fileSlots;
+  std::string lastDirectory;
+  uint32_t lastDirectoryId = 0;
+};
+
+#endif // PATH_TABLE_H
@@ -0,0 +1,194 @@
+#include "PlayerController.h"
+#include "EventLoop.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+// Cursor refresh while playing; when idle the thread sleeps until posted to
+static const int PLAYING_TICK_MS = 50;
+// Without a wake pipe nothing can interrupt the sleep, so commands are
+// picked up by polling at this interval instead
+static const int NO_PIPE_TICK_MS = 10;
+// Backward steps smaller than this are interpolation jitter, not seeks
+static const double MAX_JITTER_SECONDS = 0.25;
+
+PlayerController::PlayerController(TermMusicPlayer &player) : player(player) {
+  // On failure wakeFds stay -1 and run() falls back to a timed poll
+  if (pipe(wakeFds) == 0) {
+    for (int fd : wakeFds) {
+      fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+      fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+  }
+  currentTitle = std::make_shared<const std::string>("None");
+  publish();
+  thread = std::thread(&PlayerController::run, this);
+}
+
+PlayerController::~PlayerController() {
+  running = false;
+  wake();
+  thread.join();
+  for (int fd : wakeFds)
+    if (fd >= 0)
+      close(fd);
+}
+
+bool PlayerController::post(PlayerCommand command) {
+  if (!queue.push(std::move(command)))
+    return false;
+  wake();
+  return true;
+}
+
+bool PlayerController::play(const std::string &path) {
+  PlayerCommand command;
+  command.type = CMD_PLAY;
+  command.path = path;
+  return post(std::move(command));
+}
+
+bool PlayerController::stop() {
+  PlayerCommand command;
+  command.type = CMD_STOP;
+  return post(std::move(command));
+}
+
+bool PlayerController::togglePause() {
+  PlayerCommand command;
+  command.type = CMD_TOGGLE_PAUSE;
+  return post(std::move(command));
+}
+
+bool PlayerController::changeVolume(float delta) {
+  PlayerCommand command;
+  command.type = CMD_CHANGE_VOLUME;
+  command.value = delta;
+  return post(std::move(command));
+}
+
+bool PlayerController::seekBy(float delta) {
+  PlayerCommand command;
+  command.type = CMD_SEEK_BY;
+  command.value = delta;
+  return post(std::move(command));
+}
+
+PlaybackSnapshot PlayerController::snapshot() const { return current.load(); }
+
+std::shared_ptr<const std::string> PlayerController::title() const {
+  return std::atomic_load_explicit(&currentTitle, std::memory_order_acquire);
+}
+
+float PlayerController::smoothCursorSeconds(const PlaybackSnapshot &snap) {
+  DeviceClock clock = player.getDeviceClock();
+  ma_uint32 engineRate = player.getSampleRate();
+  if (!snap.playing() || clock.timeNs == 0 || engineRate == 0 ||
+      snap.sampleRate == 0)
+    return snap.cursorSeconds();
+
+  ma_int64 nowNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       std::chrono::steady_clock::now().time_since_epoch())
+                       .count();
+  // The device has consumed at most one more period since the callback
+  double elapsedFrames = (nowNs - clock.timeNs) * 1e-9 * engineRate;
+  double period = player.getPeriodSizeInFrames();
+  double engineNow = clock.engineFrames + std::min(elapsedFrames, period);
+  double heard = engineNow - player.getOutputLatencyFrames();
+
+  double frames = (double)snap.cursorFrames +
+                  (heard - (double)snap.engineFrames) * snap.sampleRate /
+                      engineRate;
+  frames = std::max(0.0, std::min(frames, (double)snap.lengthFrames));
+
+  if (snap.titleId == lastSmoothTitle && frames < lastSmoothFrames &&
+      lastSmoothFrames - frames < MAX_JITTER_SECONDS * snap.sampleRate)
+    frames = lastSmoothFrames;
+  lastSmoothFrames = frames;
+  lastSmoothTitle = snap.titleId;
+  return (float)(frames / snap.sampleRate);
+}
+
+void PlayerController::wake() {
+  // A full pipe already means a wakeup is pending
+  if (wakeFds[1] < 0)
+    return;
+  char byte = 1;
+  ssize_t ignored = write(wakeFds[1], &byte, 1);
+  (void)ignored;
+}
+
+void PlayerController::apply(const PlayerCommand &command) {
+  switch (command.type) {
+  case CMD_PLAY:
+    if (player.play(command.path)) {
+      std::atomic_store_explicit(
+          &currentTitle, std::make_shared<const std::string>(command.path),
+          std::memory_order_release);
+      ++titleId;
+    }
+    break;
+  case CMD_STOP:
+    player.stop();
+    break;
+  case CMD_TOGGLE_PAUSE:
+    player.togglePause();
+    break;
+  case CMD_CHANGE_VOLUME:
+    player.changeVolume(command.value);
+    break;
+  case CMD_SEEK_BY:
+    player.seekBy(command.value);
+    break;
+  }
+}
+
+void PlayerController::publish() {
+  PlaybackSnapshot next;
+  if (player.isLoaded()) {
+    next.status = player.isPlaying() ? STATUS_PLAYING : STATUS_PAUSED;
+    // Cursor and engine time both move only inside the device callback;
+    // resample if one ran between the two reads.
+    for (int attempt = 0; attempt < 3; ++attempt) {
+      next.engineFrames = player.getEngineTimeInFrames();
+      next.cursorFrames = player.getCursorInFrames();
+      if (player.getEngineTimeInFrames() == next.engineFrames)
+        break;
+    }
+    next.lengthFrames = player.getLengthInFrames();
+    next.sampleRate = player.getSoundSampleRate();
+  }
+  next.titleId = titleId;
+  next.volume = player.getVolume();
+  current.store(next);
+}
+
+void PlayerController::run() {
+  while (running) {
+    // poll() ignores a negative fd, leaving just the timeout
+    struct pollfd pfd = {wakeFds[0], POLLIN, 0};
+    int timeout = player.isPlaying() ? PLAYING_TICK_MS : -1;
+    if (wakeFds[0] < 0)
+      timeout = NO_PIPE_TICK_MS;
+    poll(&pfd, 1, timeout);
+
+    char drain[64];
+    while (wakeFds[0] >= 0 && read(wakeFds[0], drain, sizeof(drain)) > 0)
+      ;
+
+    PlayerCommand command;
+    bool applied = false;
+    while (queue.pop(command)) {
+      apply(command);
+      applied = true;
+    }
+
+    PlaybackStatus before = current.load().status;
+    publish();
+    if (applied || current.load().status != before)
+      notifyWakeFd(notifyFd.load());
+  }
+}
@@ -0,0 +1,99 @@
+#ifndef PLAYER_CONTROLLER_H
+#define PLAYER_CONTROLLER_H
+
+#include "MpscQueue.h"
+#include "MusicPlayer.h"
+#include "SeqLock.h"
+#include <memory>
+#include <string>
+#include <thread>
+
+enum PlayerCommandType {
+  CMD_PLAY,
+  CMD_STOP,
+  CMD_TOGGLE_PAUSE,
+  CMD_CHANGE_VOLUME,
+  CMD_SEEK_BY
+};
+
+struct PlayerCommand {
+  PlayerCommandType type = CMD_STOP;
+  float value = 0.0f; // Volume or seek delta
+  std::string path;   // CMD_PLAY
+};
+
+enum PlaybackStatus { STATUS_EMPTY, STATUS_PAUSED, STATUS_PLAYING };
+
+// Everything the renderer needs per frame, published as one unit. The title
+// is referenced by id so the snapshot stays trivially copyable; fetch the
+// string with PlayerController::title() only when the id changes.
+struct PlaybackSnapshot {
+  ma_uint64 cursorFrames = 0;
+  ma_uint64 engineFrames = 0; // Engine time when cursorFrames was sampled
+  ma_uint64 lengthFrames = 0; // Computed once at load
+  ma_uint32 sampleRate = 0;   // Of the sound, for both frame counts
+  ma_uint32 titleId = 0;      // 0 until something is loaded
+  float volume = 1.0f;
+  PlaybackStatus status = STATUS_EMPTY;
+
+  bool playing() const { return status == STATUS_PLAYING; }
+  float cursorSeconds() const {
+    return sampleRate ? (float)cursorFrames / sampleRate : 0.0f;
+  }
+  float lengthSeconds() const {
+    return sampleRate ? (float)lengthFrames / sampleRate : 0.0f;
+  }
+};
+
+// Owns all access to a TermMusicPlayer. Any thread may post commands
+// (lock-free, never blocks); a control thread applies them in order and
+// publishes a PlaybackSnapshot after each batch, and periodically while
+// playing so the cursor advances.
+class PlayerController {
+public:
+  explicit PlayerController(TermMusicPlayer &player);
+  ~PlayerController();
+
+  // Return false if the queue is full and the command was dropped
+  bool post(PlayerCommand command);
+  bool play(const std::string &path);
+  bool stop();
+  bool togglePause();
+  bool changeVolume(float delta);
+  bool seekBy(float delta);
+
+  // Lock-free; cheap enough to call every frame
+  PlaybackSnapshot snapshot() const;
+  // Title for snapshot().titleId, "None" before the first load
+  std::shared_ptr<const std::string> title() const;
+  // fd gets a notifyWakeFd() after every batch of commands and whenever
+  // playback starts or stops on its own (a track ending), so a UI can
+  // sleep until then. The cursor advancing is not reported.
+  void setNotifyFd(int fd) { notifyFd = fd; }
+
+  // What is audible right now, in seconds. Extrapolates the snapshot's
+  // cursor from the last device callback with the monotonic clock and
+  // subtracts output latency, so it moves smoothly between callbacks
+  // instead of in period-sized steps. Call from a single (render) thread.
+  float smoothCursorSeconds(const PlaybackSnapshot &snap);
+
+private:
+  TermMusicPlayer &player;
+  MpscQueue<PlayerCommand, 64> queue;
+  SeqLock<PlaybackSnapshot> current;
+  std::shared_ptr<const std::string> currentTitle; // Swapped per track
+  ma_uint32 titleId = 0;                          // Control thread only
+  double lastSmoothFrames = 0.0;                  // Render thread only
+  ma_uint32 lastSmoothTitle = 0;
+  std::thread thread;
+  std::atomic<bool> running{true};
+  int wakeFds[2] = {-1, -1}; // Self-pipe: producers write, thread polls
+  std::atomic<int> notifyFd{-1};
+
+  void run();
+  void wake();
+  void apply(const PlayerCommand &command);
+  void publish();
+};
+
+#endif // PLAYER_CONTROLLER_H
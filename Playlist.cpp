@@ -0,0 +1,306 @@
+#include "Playlist.h"
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+PlaylistFormat playlistFormatFor(const std::string &path) {
+  size_t dot = path.rfind('.');
+  if (dot != std::string::npos && strcasecmp(path.c_str() + dot, ".pls") == 0)
+    return PLAYLIST_PLS;
+  return PLAYLIST_M3U;
+}
+
+static std::string workingDirectory() {
+  char buffer[4096];
+  return getcwd(buffer, sizeof(buffer)) ? std::string(buffer) : std::string();
+}
+
+static int hexValue(char c) {
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  return -1;
+}
+
+// Turns playlist entries into library-relative paths. Every buffer is
+// reused, so resolving an entry allocates nothing once they have grown.
+struct PathResolver {
+  std::string cwd;  // Absolute, no trailing slash
+  std::string base; // Playlist directory, library-relative or absolute
+  std::string scratch;
+  std::vector<size_t> starts; // Offsets of the components in out
+
+  // Appends the '/'-separated components of p, folding "." and "..".
+  void appendComponents(const char *p, size_t size, std::string &out) {
+    bool absolute = !out.empty() && out[0] == '/';
+    size_t i = 0;
+    while (i < size) {
+      const char *slash = (const char *)memchr(p + i, '/', size - i);
+      size_t end = slash ? slash - p : size;
+      size_t length = end - i;
+      if (length == 2 && p[i] == '.' && p[i + 1] == '.' && !starts.empty() &&
+          out.compare(starts.back(), std::string::npos, "..") != 0) {
+        size_t back = starts.back();
+        starts.pop_back();
+        out.resize(back == (absolute ? 1u : 0u) ? back : back - 1);
+      } else if (length > 0 && !(length == 1 && p[i] == '.')) {
+        if (!out.empty() && out.back() != '/')
+          out += '/';
+        starts.push_back(out.size());
+        out.append(p + i, length);
+      }
+      i = end + 1;
+    }
+  }
+
+  // Normalizes an absolute or base-relative path into out, then makes it
+  // relative to cwd if it lies below it.
+  void resolve(const char *p, size_t size, std::string &out) {
+    out.clear();
+    starts.clear();
+    if (size > 0 && p[0] == '/') {
+      out = "/";
+    } else {
+      if (!base.empty() && base[0] == '/')
+        out = "/";
+      appendComponents(base.data(), base.size(), out);
+    }
+    appendComponents(p, size, out);
+    if (out == cwd)
+      out.clear();
+    else if (out.size() > cwd.size() + 1 && out[0] == '/' &&
+        out.compare(0, cwd.size(), cwd) == 0 && out[cwd.size()] == '/')
+      out.erase(0, cwd.size() + 1);
+  }
+
+  // One playlist entry: a path or file:// URL, Windows separators allowed.
+  // Returns false for entries that are not local files (streams).
+  bool resolveEntry(const char *p, size_t size, std::string &out) {
+    if (size >= 7 && strncasecmp(p, "file://", 7) == 0) {
+      p += 7;
+      size -= 7;
+      if (size >= 9 && strncasecmp(p, "localhost", 9) == 0) {
+        p += 9;
+        size -= 9;
+      }
+      scratch.clear();
+      for (size_t i = 0; i < size; ++i) {
+        int high, low;
+        if (p[i] == '%' && i + 2 < size && (high = hexValue(p[i + 1])) >= 0 &&
+            (low = hexValue(p[i + 2])) >= 0) {
+          scratch += (char)(high * 16 + low);
+          i += 2;
+        } else {
+          scratch += p[i];
+        }
+      }
+    } else {
+      for (size_t i = 0; i + 2 < size && p[i] != '/'; ++i)
+        if (p[i] == ':' && p[i + 1] == '/' && p[i + 2] == '/')
+          return false; // http:// and other streams
+      if (!memchr(p, '\\', size)) {
+        resolve(p, size, out);
+        return !out.empty();
+      }
+      scratch.assign(p, size);
+    }
+    for (char &c : scratch)
+      if (c == '\\')
+        c = '/';
+    resolve(scratch.data(), scratch.size(), out);
+    return !out.empty();
+  }
+};
+
+// The playlist's directory, resolved like an entry against the working
+// directory. It is taken from the absolute path, so a directory beside the
+// library ("../other") ends up absolute rather than starting with "..",
+// which entries could never be matched against.
+static void setBase(PathResolver &resolver, const std::string &playlistPath) {
+  resolver.cwd = workingDirectory();
+  resolver.base.clear();
+  size_t slash = playlistPath.rfind('/');
+  if (slash == std::string::npos)
+    return;
+  std::string directory = playlistPath.substr(0, slash == 0 ? 1 : slash);
+  if (directory[0] != '/' && !resolver.cwd.empty())
+    directory = resolver.cwd + "/" + directory;
+  std::string base;
+  resolver.resolve(directory.data(), directory.size(), base);
+  resolver.base = base;
+}
+
+// How to get from the absolute directory base to cwd, ending in '/': up to
+// the directory they share, then down. Absolute if they share only the root.
+static std::string pathToCwd(const std::string &base, const std::string &cwd) {
+  size_t common = 0;
+  for (size_t i = 1; i <= base.size() && i <= cwd.size(); ++i) {
+    if (base[i - 1] != cwd[i - 1])
+      break;
+    if ((i == base.size() || base[i] == '/') &&
+        (i == cwd.size() || cwd[i] == '/'))
+      common = i;
+  }
+  if (common <= 1)
+    return cwd + "/";
+  std::string path;
+  for (size_t i = common; i < base.size(); ++i)
+    if (base[i] == '/')
+      path += "../";
+  if (common < cwd.size())
+    path += cwd.substr(common + 1) + "/";
+  return path;
+}
+
+static bool isSpace(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+bool Playlist::load(const std::string &path, TrackList &tracks) {
+  entries.clear();
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    std::cerr << "Cannot open playlist " << path << std::endl;
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return false;
+  }
+  if (st.st_size == 0) {
+    close(fd);
+    return true;
+  }
+  void *mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    std::cerr << "Cannot read playlist " << path << std::endl;
+    return false;
+  }
+  madvise(mapping, st.st_size, MADV_SEQUENTIAL);
+
+  PathResolver resolver;
+  setBase(resolver, path);
+  bool pls = playlistFormatFor(path) == PLAYLIST_PLS;
+  std::string resolved;
+  const char *data = (const char *)mapping;
+  const char *end = data + st.st_size;
+  if (end - data >= 3 && memcmp(data, "\xEF\xBB\xBF", 3) == 0)
+    data += 3; // UTF-8 byte order mark
+
+  while (data < end) {
+    const char *newline = (const char *)memchr(data, '\n', end - data);
+    const char *lineEnd = newline ? newline : end;
+    const char *line = data;
+    data = newline ? newline + 1 : end;
+    while (line < lineEnd && isSpace(*line))
+      ++line;
+    while (lineEnd > line && isSpace(lineEnd[-1]))
+      --lineEnd;
+    if (line == lineEnd)
+      continue;
+
+    if (pls) {
+      // FileN=path; titles, lengths and the header are not needed.
+      if (lineEnd - line < 6 || strncasecmp(line, "file", 4) != 0)
+        continue;
+      const char *equals = line + 4;
+      while (equals < lineEnd && *equals >= '0' && *equals <= '9')
+        ++equals;
+      if (equals == line + 4 || equals == lineEnd || *equals != '=')
+        continue;
+      line = equals + 1;
+    } else if (*line == '#') {
+      continue; // #EXTM3U, #EXTINF and comments
+    }
+
+    if (resolver.resolveEntry(line, lineEnd - line, resolved))
+      entries.push_back(tracks.intern(resolved));
+  }
+  munmap(mapping, st.st_size);
+  return true;
+}
+
+size_t Playlist::find(TrackId id, size_t from) const {
+  for (size_t i = 0; i < entries.size(); ++i) {
+    size_t index = (from + i) % entries.size();
+    if (entries[index] == id)
+      return index;
+  }
+  return entries.size();
+}
+
+bool Playlist::save(const std::string &path, const TrackList &tracks,
+                    std::string &error) const {
+  PathResolver resolver;
+  setBase(resolver, path);
+  // Entries are written relative to the playlist: up out of its directory
+  // when it is inside the library, through the directory it shares with the
+  // library when it is beside it, absolute when they share nothing.
+  std::string prefix;
+  if (!resolver.base.empty() && resolver.base[0] == '/') {
+    prefix = pathToCwd(resolver.base, resolver.cwd);
+  } else if (!resolver.base.empty()) {
+    prefix = "../";
+    for (char c : resolver.base)
+      if (c == '/')
+        prefix += "../";
+  }
+
+  std::string tmpPath = path + ".tmp";
+  FILE *file = fopen(tmpPath.c_str(), "wb");
+  if (!file) {
+    error = "Cannot write " + tmpPath;
+    return false;
+  }
+  bool pls = playlistFormatFor(path) == PLAYLIST_PLS;
+  fputs(pls ? "[playlist]\n" : "#EXTM3U\n", file);
+  std::string entry;
+  std::string label;
+  for (size_t i = 0; i < entries.size(); ++i) {
+    TrackId id = entries[i];
+    entry.clear();
+    tracks.getPaths().appendPath(id, entry);
+    if (entry[0] != '/') {
+      if (!prefix.empty() && resolver.base[0] != '/' &&
+          entry.compare(0, resolver.base.size(), resolver.base) == 0 &&
+          entry[resolver.base.size()] == '/')
+        entry.erase(0, resolver.base.size() + 1); // Below the playlist
+      else
+        entry.insert(0, prefix);
+    }
+    const AudioProbeInfo &info = tracks.meta(id).info;
+    long seconds = info.ok ? (long)(info.seconds() + 0.5) : -1;
+    label = tracks.tag(id, TAG_TITLE);
+    if (!label.empty() && !tracks.tag(id, TAG_ARTIST).empty())
+      label = tracks.tag(id, TAG_ARTIST) + " - " + label;
+    if (label.empty())
+      label = tracks.getPaths().fileName(id);
+
+    if (pls) {
+      fprintf(file, "File%zu=%s\nTitle%zu=%s\nLength%zu=%ld\n", i + 1,
+              entry.c_str(), i + 1, label.c_str(), i + 1, seconds);
+    } else {
+      fprintf(file, "#EXTINF:%ld,%s\n%s\n", seconds, label.c_str(),
+              entry.c_str());
+    }
+  }
+  if (pls)
+    fprintf(file, "NumberOfEntries=%zu\nVersion=2\n", entries.size());
+
+  bool ok = !ferror(file);
+  ok = fclose(file) == 0 && ok;
+  if (!ok || rename(tmpPath.c_str(), path.c_str()) != 0) {
+    error = "Cannot write " + path;
+    unlink(tmpPath.c_str());
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,44 @@
+#ifndef PLAYLIST_H
+#define PLAYLIST_H
+
+#include "TrackList.h"
+#include <cstddef>
+#include <string>
+#include <vector>
+
+enum PlaylistFormat { PLAYLIST_M3U, PLAYLIST_PLS };
+
+// M3U/M3U8 or PLS by extension (.pls), M3U otherwise.
+PlaylistFormat playlistFormatFor(const std::string &path);
+
+// An ordered list of tracks loaded from or saved to a playlist file.
+// Entries may repeat and need not be in the library.
+class Playlist {
+public:
+  // Maps path and parses it in place: lines are walked as pointers into
+  // the mapping, and each entry is resolved into one reused buffer before
+  // being interned in tracks' path table. Relative entries are taken
+  // relative to the playlist's directory, absolute ones and file:// URLs
+  // under the working directory become library-relative. Returns false if
+  // the file cannot be read.
+  bool load(const std::string &path, TrackList &tracks);
+  // Writes entries with their lengths and tags to a temporary file and
+  // renames it over path. Paths are written relative to the playlist. On
+  // failure error says why, for the UI to show.
+  bool save(const std::string &path, const TrackList &tracks,
+            std::string &error) const;
+
+  void assign(const std::vector<TrackId> &ids) { entries = ids; }
+  size_t size() const { return entries.size(); }
+  bool empty() const { return entries.empty(); }
+  TrackId at(size_t index) const { return entries[index]; }
+  // Index of the first entry for id at or after from, wrapping around;
+  // size() if the playlist does not list it.
+  size_t find(TrackId id, size_t from) const;
+  const std::vector<TrackId> &getEntries() const { return entries; }
+
+private:
+  std::vector<TrackId> entries;
+};
+
+#endif // PLAYLIST_H
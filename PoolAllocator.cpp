@@ -0,0 +1,212 @@
+#include "PoolAllocator.h"
+
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+// Largest payload of each class; blocks also hold a Header
+const size_t CLASS_SIZES[PoolAllocator::CLASS_COUNT] = {
+    64, 128, 256, 512, 1024, 2048, 4096, 8192, 16384, 65536};
+const size_t SLAB_BYTES = 64 * 1024;
+const size_t MIN_SLAB_BLOCKS = 4;
+const ma_uint32 LARGE_CLASS = 0xFFFFFFFF;
+
+// Precedes every block. 16 bytes keeps the user pointer 16-byte aligned.
+struct Header {
+  ma_uint32 sizeClass;
+  ma_uint32 category;
+  ma_uint64 size; // Requested size
+};
+static_assert(sizeof(Header) == 16, "Header must preserve alignment");
+
+// Precedes the first block of a slab and links the class's slabs
+struct alignas(16) SlabHeader {
+  void *next;
+};
+static_assert(sizeof(SlabHeader) == 16, "SlabHeader must preserve alignment");
+
+thread_local AllocCategory t_category = ALLOC_TRACK;
+
+int classFor(size_t size) {
+  for (int i = 0; i < PoolAllocator::CLASS_COUNT; ++i)
+    if (size <= CLASS_SIZES[i])
+      return i;
+  return -1;
+}
+
+} // namespace
+
+AllocScope::AllocScope(AllocCategory category) : previous(t_category) {
+  t_category = category;
+}
+
+AllocScope::~AllocScope() { t_category = previous; }
+
+PoolAllocator::PoolAllocator() {
+  for (int c = 0; c < ALLOC_CATEGORY_COUNT; ++c) {
+    liveBytes[c] = 0;
+    peakBytes[c] = 0;
+    allocCount[c] = 0;
+    freeCount[c] = 0;
+  }
+}
+
+PoolAllocator::~PoolAllocator() {
+  for (SizeClass &sc : classes) {
+    while (sc.slabs != nullptr) {
+      void *next = ((SlabHeader *)sc.slabs)->next;
+      free(sc.slabs);
+      sc.slabs = next;
+    }
+  }
+}
+
+ma_allocation_callbacks PoolAllocator::callbacks() {
+  ma_allocation_callbacks cb;
+  cb.pUserData = this;
+  cb.onMalloc = onMalloc;
+  cb.onRealloc = onRealloc;
+  cb.onFree = onFree;
+  return cb;
+}
+
+void PoolAllocator::beginTrack() {
+  trackAllocBase = allocCount[ALLOC_TRACK].load(std::memory_order_relaxed);
+}
+
+AllocStats PoolAllocator::getStats() const {
+  AllocStats stats;
+  for (int c = 0; c < ALLOC_CATEGORY_COUNT; ++c) {
+    stats.category[c].liveBytes = liveBytes[c].load(std::memory_order_relaxed);
+    stats.category[c].peakBytes = peakBytes[c].load(std::memory_order_relaxed);
+    stats.category[c].allocs = allocCount[c].load(std::memory_order_relaxed);
+    stats.category[c].frees = freeCount[c].load(std::memory_order_relaxed);
+  }
+  stats.trackAllocs = stats.category[ALLOC_TRACK].allocs -
+                      trackAllocBase.load(std::memory_order_relaxed);
+  stats.pooledBytes = pooledBytes.load(std::memory_order_relaxed);
+  stats.largeBytes = largeBytes.load(std::memory_order_relaxed);
+  return stats;
+}
+
+void *PoolAllocator::allocate(size_t size) {
+  int sizeClass = classFor(size);
+  Header *pHeader;
+
+  if (sizeClass < 0) {
+    pHeader = (Header *)malloc(size + sizeof(Header));
+    if (pHeader == nullptr)
+      return nullptr;
+    pHeader->sizeClass = LARGE_CLASS;
+    largeBytes.fetch_add(size, std::memory_order_relaxed);
+  } else {
+    SizeClass &sc = classes[sizeClass];
+    std::lock_guard<std::mutex> lock(sc.mutex);
+    if (sc.freeList == nullptr) {
+      // Carve a new slab; only a small header links the slab list
+      const size_t blockSize = CLASS_SIZES[sizeClass] + sizeof(Header);
+      size_t blockCount = SLAB_BYTES / blockSize;
+      if (blockCount < MIN_SLAB_BLOCKS)
+        blockCount = MIN_SLAB_BLOCKS;
+      const size_t slabSize = sizeof(SlabHeader) + blockCount * blockSize;
+      SlabHeader *pSlab = (SlabHeader *)malloc(slabSize);
+      if (pSlab == nullptr)
+        return nullptr;
+      pSlab->next = sc.slabs;
+      sc.slabs = pSlab;
+      char *pBlocks = (char *)(pSlab + 1);
+      for (size_t i = blockCount; i-- > 0;) {
+        FreeBlock *pBlock = (FreeBlock *)(pBlocks + i * blockSize);
+        pBlock->next = sc.freeList;
+        sc.freeList = pBlock;
+      }
+      pooledBytes.fetch_add(slabSize, std::memory_order_relaxed);
+    }
+    pHeader = (Header *)sc.freeList;
+    sc.freeList = sc.freeList->next;
+    pHeader->sizeClass = (ma_uint32)sizeClass;
+  }
+
+  AllocCategory category = t_category;
+  pHeader->category = category;
+  pHeader->size = size;
+
+  allocCount[category].fetch_add(1, std::memory_order_relaxed);
+  ma_uint64 live =
+      liveBytes[category].fetch_add(size, std::memory_order_relaxed) + size;
+  updatePeak(category, live);
+
+  return pHeader + 1;
+}
+
+void PoolAllocator::updatePeak(AllocCategory category, ma_uint64 live) {
+  ma_uint64 peak = peakBytes[category].load(std::memory_order_relaxed);
+  while (live > peak && !peakBytes[category].compare_exchange_weak(
+                            peak, live, std::memory_order_relaxed))
+    ;
+}
+
+void PoolAllocator::release(void *p) {
+  if (p == nullptr)
+    return;
+  Header *pHeader = (Header *)p - 1;
+
+  liveBytes[pHeader->category].fetch_sub(pHeader->size,
+                                         std::memory_order_relaxed);
+  freeCount[pHeader->category].fetch_add(1, std::memory_order_relaxed);
+
+  if (pHeader->sizeClass == LARGE_CLASS) {
+    largeBytes.fetch_sub(pHeader->size, std::memory_order_relaxed);
+    free(pHeader);
+    return;
+  }
+
+  SizeClass &sc = classes[pHeader->sizeClass];
+  std::lock_guard<std::mutex> lock(sc.mutex);
+  FreeBlock *pBlock = (FreeBlock *)pHeader;
+  pBlock->next = sc.freeList;
+  sc.freeList = pBlock;
+}
+
+void *PoolAllocator::reallocate(void *p, size_t size) {
+  if (p == nullptr)
+    return allocate(size);
+  if (size == 0) {
+    release(p);
+    return nullptr;
+  }
+
+  Header *pHeader = (Header *)p - 1;
+  // Still fits its block: only the accounting changes
+  if (pHeader->sizeClass != LARGE_CLASS &&
+      size <= CLASS_SIZES[pHeader->sizeClass]) {
+    AllocCategory category = (AllocCategory)pHeader->category;
+    ma_uint64 live = liveBytes[category].fetch_add(size - pHeader->size,
+                                                   std::memory_order_relaxed) +
+                     (size - pHeader->size);
+    if (size > pHeader->size)
+      updatePeak(category, live);
+    pHeader->size = size;
+    return p;
+  }
+
+  void *pNew = allocate(size);
+  if (pNew == nullptr)
+    return nullptr;
+  memcpy(pNew, p, pHeader->size < size ? pHeader->size : size);
+  release(p);
+  return pNew;
+}
+
+void *PoolAllocator::onMalloc(size_t size, void *pUserData) {
+  return ((PoolAllocator *)pUserData)->allocate(size);
+}
+
+void *PoolAllocator::onRealloc(void *p, size_t size, void *pUserData) {
+  return ((PoolAllocator *)pUserData)->reallocate(p, size);
+}
+
+void PoolAllocator::onFree(void *p, void *pUserData) {
+  ((PoolAllocator *)pUserData)->release(p);
+}
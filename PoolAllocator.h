@@ -0,0 +1,85 @@
+#ifndef POOL_ALLOCATOR_H
+#define POOL_ALLOCATOR_H
+
+#include "miniaudio.h"
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+
+// Who an allocation is charged to. Allocations are tagged with the category
+// of the thread that made them (see AllocScope); untagged threads, such as
+// miniaudio's resource manager job thread, only ever allocate for sounds
+// and so default to ALLOC_TRACK.
+enum AllocCategory { ALLOC_ENGINE, ALLOC_TRACK, ALLOC_CATEGORY_COUNT };
+
+struct AllocCategoryStats {
+  ma_uint64 liveBytes = 0;
+  ma_uint64 peakBytes = 0;
+  ma_uint64 allocs = 0;
+  ma_uint64 frees = 0;
+};
+
+struct AllocStats {
+  AllocCategoryStats category[ALLOC_CATEGORY_COUNT];
+  ma_uint64 trackAllocs = 0;  // Allocations since the last beginTrack()
+  ma_uint64 pooledBytes = 0;  // Slab memory reserved for the size classes
+  ma_uint64 largeBytes = 0;   // Live allocations too big for any class
+};
+
+// Size-class pool for miniaudio, plugged in through ma_allocation_callbacks.
+// Classes are sized to what the engine and decoders actually request (small
+// node/resource structs, ~16 KiB decoder state, 64 KiB stream buffers);
+// anything larger, like a preloaded encoded file, goes straight to malloc.
+// Freed blocks are recycled, never returned to the system, which keeps long
+// sessions with many track changes from fragmenting the heap.
+class PoolAllocator {
+public:
+  static const int CLASS_COUNT = 10;
+
+  PoolAllocator();
+  ~PoolAllocator();
+
+  ma_allocation_callbacks callbacks();
+
+  void beginTrack();
+  AllocStats getStats() const;
+
+private:
+  struct FreeBlock {
+    FreeBlock *next;
+  };
+  struct SizeClass {
+    std::mutex mutex;
+    FreeBlock *freeList = nullptr;
+    void *slabs = nullptr; // Linked through a header before the first block
+  };
+
+  SizeClass classes[CLASS_COUNT];
+  std::atomic<ma_uint64> liveBytes[ALLOC_CATEGORY_COUNT];
+  std::atomic<ma_uint64> peakBytes[ALLOC_CATEGORY_COUNT];
+  std::atomic<ma_uint64> allocCount[ALLOC_CATEGORY_COUNT];
+  std::atomic<ma_uint64> freeCount[ALLOC_CATEGORY_COUNT];
+  std::atomic<ma_uint64> trackAllocBase{0};
+  std::atomic<ma_uint64> pooledBytes{0};
+  std::atomic<ma_uint64> largeBytes{0};
+
+  void *allocate(size_t size);
+  void *reallocate(void *p, size_t size);
+  void release(void *p);
+  void updatePeak(AllocCategory category, ma_uint64 live);
+
+  static void *onMalloc(size_t size, void *pUserData);
+  static void *onRealloc(void *p, size_t size, void *pUserData);
+  static void onFree(void *p, void *pUserData);
+};
+
+// Charges allocations made on this thread to a category until destroyed
+class AllocScope {
+  AllocCategory previous;
+
+public:
+  explicit AllocScope(AllocCategory category);
+  ~AllocScope();
+};
+
+#endif // POOL_ALLOCATOR_H
@@ -0,0 +1,324 @@
+#include "ReadAheadVfs.h"
+#include "VfsUtils.h"
+
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <fcntl.h>
+#include <mutex>
+#include <new>
+#include <sys/stat.h>
+#include <system_error>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+const ma_uint64 NO_BLOCK = ~(ma_uint64)0;
+
+struct Slot {
+  ma_uint64 block = NO_BLOCK; // Block index held (or being fetched)
+  bool ready = false;
+  size_t length = 0; // Valid bytes, short for the last block
+  int error = 0;     // errno of a failed pread; length bytes came before it
+  std::vector<unsigned char> data;
+};
+
+// Block b lives in slot b % depth. The window is [base, base + depth); the
+// I/O thread fills it in order and the reader slides it forward.
+struct ReadAheadFile {
+  ReadAheadVfs *pVfs;
+  int fd;
+  ma_uint64 size;
+  ma_uint64 cursor = 0; // Decoder thread only
+
+  std::mutex mutex;
+  std::condition_variable fetched; // I/O thread -> reader
+  std::condition_variable moved;   // Reader -> I/O thread
+  ma_uint64 base = 0;
+  bool quit = false;
+  std::vector<Slot> slots;
+  std::thread io;
+};
+
+} // namespace
+
+static void atomicMax(std::atomic<ma_uint64> &value, ma_uint64 candidate) {
+  ma_uint64 current = value.load(std::memory_order_relaxed);
+  while (candidate > current &&
+         !value.compare_exchange_weak(current, candidate,
+                                      std::memory_order_relaxed))
+    ;
+}
+
+static void ioThread(ReadAheadFile *pFile) {
+  const size_t blockSize = pFile->pVfs->blockSize;
+  const ma_uint64 blockCount = (pFile->size + blockSize - 1) / blockSize;
+  const int depth = (int)pFile->slots.size();
+
+  std::unique_lock<std::mutex> lock(pFile->mutex);
+  while (!pFile->quit) {
+    // Lowest block in the window that is not held yet
+    ma_uint64 next = NO_BLOCK;
+    for (ma_uint64 b = pFile->base;
+         b < pFile->base + depth && b < blockCount; ++b) {
+      if (pFile->slots[b % depth].block != b) {
+        next = b;
+        break;
+      }
+    }
+    if (next == NO_BLOCK) {
+      pFile->moved.wait(lock);
+      continue;
+    }
+
+    Slot &slot = pFile->slots[next % depth];
+    slot.block = next;
+    slot.ready = false;
+
+    // pread without the lock; the reader waits on this slot meanwhile
+    lock.unlock();
+    size_t length = 0;
+    int error = 0;
+    while (length < blockSize) {
+      ssize_t n = pread(pFile->fd, slot.data.data() + length,
+                        blockSize - length, next * blockSize + length);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n < 0)
+        error = errno;
+      if (n <= 0)
+        break;
+      length += (size_t)n;
+    }
+    pFile->pVfs->bytesFetched.fetch_add(length, std::memory_order_relaxed);
+    lock.lock();
+
+    slot.length = length;
+    slot.error = error;
+    slot.ready = true;
+    pFile->fetched.notify_all();
+  }
+}
+
+static ma_result read_ahead_vfs_open(ma_vfs *pVFS, const char *pFilePath,
+                                     ma_uint32 openMode, ma_vfs_file *pFile) {
+  ReadAheadVfs *pVfs = (ReadAheadVfs *)pVFS;
+  if (pFile == NULL)
+    return MA_INVALID_ARGS;
+  *pFile = NULL;
+
+  // Decoders only ever read
+  if ((openMode & MA_OPEN_MODE_WRITE) != 0)
+    return MA_NOT_IMPLEMENTED;
+
+  int fd = open(pFilePath, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return vfsResultFromErrno(errno);
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    int err = errno;
+    close(fd);
+    return vfsResultFromErrno(err);
+  }
+
+  ReadAheadFile *pRa = new (std::nothrow) ReadAheadFile;
+  if (pRa == NULL) {
+    close(fd);
+    return MA_OUT_OF_MEMORY;
+  }
+  pRa->pVfs = pVfs;
+  pRa->fd = fd;
+  pRa->size = (ma_uint64)st.st_size;
+  // Exceptions must not unwind through miniaudio's C frames
+  try {
+    pRa->slots.resize(pVfs->depth);
+    for (Slot &slot : pRa->slots)
+      slot.data.resize(pVfs->blockSize);
+    pRa->io = std::thread(ioThread, pRa);
+  } catch (const std::exception &) {
+    // bad_alloc, or system_error when no thread can be started
+    delete pRa;
+    close(fd);
+    return MA_OUT_OF_MEMORY;
+  }
+
+  *pFile = pRa;
+  return MA_SUCCESS;
+}
+
+static ma_result read_ahead_vfs_open_w(ma_vfs *pVFS, const wchar_t *pFilePath,
+                                       ma_uint32 openMode,
+                                       ma_vfs_file *pFile) {
+  (void)pVFS;
+  (void)pFilePath;
+  (void)openMode;
+  (void)pFile;
+  return MA_NOT_IMPLEMENTED;
+}
+
+static ma_result read_ahead_vfs_close(ma_vfs *pVFS, ma_vfs_file file) {
+  (void)pVFS;
+  ReadAheadFile *pRa = (ReadAheadFile *)file;
+  if (pRa == NULL)
+    return MA_INVALID_ARGS;
+  {
+    std::lock_guard<std::mutex> lock(pRa->mutex);
+    pRa->quit = true;
+  }
+  pRa->moved.notify_all();
+  pRa->io.join();
+  close(pRa->fd);
+  delete pRa;
+  return MA_SUCCESS;
+}
+
+// Mirrors the stdio VFS: short reads succeed, MA_AT_END only when nothing
+// is left. A failed pread is returned as an error once the bytes before it
+// have been read, so an EIO does not look like the end of the track.
+static ma_result read_ahead_vfs_read(ma_vfs *pVFS, ma_vfs_file file,
+                                     void *pDst, size_t sizeInBytes,
+                                     size_t *pBytesRead) {
+  ReadAheadVfs *pVfs = (ReadAheadVfs *)pVFS;
+  ReadAheadFile *pRa = (ReadAheadFile *)file;
+  const size_t blockSize = pVfs->blockSize;
+  const int depth = (int)pRa->slots.size();
+  unsigned char *pOut = (unsigned char *)pDst;
+  size_t total = 0;
+  int error = 0;
+
+  std::unique_lock<std::mutex> lock(pRa->mutex);
+  while (total < sizeInBytes && pRa->cursor < pRa->size) {
+    ma_uint64 block = pRa->cursor / blockSize;
+    Slot &slot = pRa->slots[block % depth];
+
+    bool miss = block < pRa->base || block >= pRa->base + depth;
+    if (miss) {
+      // Seeked away: restart the window here
+      pVfs->misses.fetch_add(1, std::memory_order_relaxed);
+      pRa->base = block;
+      pRa->moved.notify_one();
+    } else if (block > pRa->base) {
+      // Consumed blocks free their slots for the I/O thread
+      pRa->base = block;
+      pRa->moved.notify_one();
+    }
+
+    if (slot.block == block && slot.ready) {
+      pVfs->hits.fetch_add(1, std::memory_order_relaxed);
+    } else {
+      if (!miss)
+        pVfs->stalls.fetch_add(1, std::memory_order_relaxed);
+      auto start = std::chrono::steady_clock::now();
+      pRa->fetched.wait(lock, [&] {
+        return slot.block == block && slot.ready;
+      });
+      ma_uint64 ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+      pVfs->stallNs.fetch_add(ns, std::memory_order_relaxed);
+      atomicMax(pVfs->maxStallNs, ns);
+    }
+
+    size_t offset = (size_t)(pRa->cursor - block * blockSize);
+    if (offset >= slot.length) {
+      if (slot.error != 0) {
+        // Report it, and let the I/O thread try the block again next time
+        error = slot.error;
+        slot.block = NO_BLOCK;
+        slot.ready = false;
+        slot.error = 0;
+        pRa->moved.notify_one();
+      }
+      break; // Otherwise the file shrank underneath us
+    }
+    size_t bytes = slot.length - offset;
+    if (bytes > sizeInBytes - total)
+      bytes = sizeInBytes - total;
+    memcpy(pOut + total, slot.data.data() + offset, bytes);
+    total += bytes;
+    pRa->cursor += bytes;
+  }
+  lock.unlock();
+
+  if (pBytesRead != NULL)
+    *pBytesRead = total;
+  if (total == 0 && error != 0)
+    return vfsResultFromErrno(error);
+  return (total == 0 && sizeInBytes > 0) ? MA_AT_END : MA_SUCCESS;
+}
+
+static ma_result read_ahead_vfs_write(ma_vfs *pVFS, ma_vfs_file file,
+                                      const void *pSrc, size_t sizeInBytes,
+                                      size_t *pBytesWritten) {
+  (void)pVFS;
+  (void)file;
+  (void)pSrc;
+  (void)sizeInBytes;
+  if (pBytesWritten != NULL)
+    *pBytesWritten = 0;
+  return MA_NOT_IMPLEMENTED;
+}
+
+// Seeking only moves the cursor; the window follows on the next read
+static ma_result read_ahead_vfs_seek(ma_vfs *pVFS, ma_vfs_file file,
+                                     ma_int64 offset, ma_seek_origin origin) {
+  (void)pVFS;
+  ReadAheadFile *pRa = (ReadAheadFile *)file;
+  ma_int64 base = 0;
+  if (origin == ma_seek_origin_current)
+    base = (ma_int64)pRa->cursor;
+  else if (origin == ma_seek_origin_end)
+    base = (ma_int64)pRa->size;
+
+  if (base + offset < 0)
+    return MA_BAD_SEEK;
+  pRa->cursor = (ma_uint64)(base + offset);
+  return MA_SUCCESS;
+}
+
+static ma_result read_ahead_vfs_tell(ma_vfs *pVFS, ma_vfs_file file,
+                                     ma_int64 *pCursor) {
+  (void)pVFS;
+  *pCursor = (ma_int64)((ReadAheadFile *)file)->cursor;
+  return MA_SUCCESS;
+}
+
+static ma_result read_ahead_vfs_info(ma_vfs *pVFS, ma_vfs_file file,
+                                     ma_file_info *pInfo) {
+  (void)pVFS;
+  pInfo->sizeInBytes = ((ReadAheadFile *)file)->size;
+  return MA_SUCCESS;
+}
+
+void readAheadVfsInit(ReadAheadVfs *pVfs, size_t blockSize, int depth) {
+  pVfs->cb.onOpen = read_ahead_vfs_open;
+  pVfs->cb.onOpenW = read_ahead_vfs_open_w;
+  pVfs->cb.onClose = read_ahead_vfs_close;
+  pVfs->cb.onRead = read_ahead_vfs_read;
+  pVfs->cb.onWrite = read_ahead_vfs_write;
+  pVfs->cb.onSeek = read_ahead_vfs_seek;
+  pVfs->cb.onTell = read_ahead_vfs_tell;
+  pVfs->cb.onInfo = read_ahead_vfs_info;
+
+  // Page aligned blocks keep preads aligned for O_DIRECT-like backends
+  const size_t page = 4096;
+  if (blockSize < page)
+    blockSize = page;
+  pVfs->blockSize = (blockSize + page - 1) / page * page;
+  pVfs->depth = depth < 2 ? 2 : depth;
+}
+
+ReadAheadStats readAheadVfsGetStats(const ReadAheadVfs *pVfs) {
+  ReadAheadStats stats;
+  stats.hits = pVfs->hits.load(std::memory_order_relaxed);
+  stats.stalls = pVfs->stalls.load(std::memory_order_relaxed);
+  stats.misses = pVfs->misses.load(std::memory_order_relaxed);
+  stats.stallNs = pVfs->stallNs.load(std::memory_order_relaxed);
+  stats.maxStallNs = pVfs->maxStallNs.load(std::memory_order_relaxed);
+  stats.bytesFetched = pVfs->bytesFetched.load(std::memory_order_relaxed);
+  return stats;
+}
@@ -0,0 +1,39 @@
+#ifndef READ_AHEAD_VFS_H
+#define READ_AHEAD_VFS_H
+
+#include "miniaudio.h"
+#include <atomic>
+#include <cstddef>
+
+// Counters shared by every file opened through a ReadAheadVfs
+struct ReadAheadStats {
+  ma_uint64 hits = 0;    // Block was already prefetched
+  ma_uint64 stalls = 0;  // Block was in flight, decoder had to wait
+  ma_uint64 misses = 0;  // Read outside the window (seek), window restarted
+  ma_uint64 stallNs = 0; // Total time decoders spent waiting
+  ma_uint64 maxStallNs = 0;
+  ma_uint64 bytesFetched = 0;
+};
+
+// Read-only ma_vfs for slow or network storage. Each open file gets an I/O
+// thread that keeps `depth` aligned blocks of `blockSize` bytes prefetched
+// ahead of the read cursor, so a storage latency spike is absorbed by the
+// ring instead of stalling the decoder.
+struct ReadAheadVfs {
+  ma_vfs_callbacks cb; // Must be first, miniaudio casts ma_vfs* to this
+  size_t blockSize;
+  int depth;
+
+  std::atomic<ma_uint64> hits{0};
+  std::atomic<ma_uint64> stalls{0};
+  std::atomic<ma_uint64> misses{0};
+  std::atomic<ma_uint64> stallNs{0};
+  std::atomic<ma_uint64> maxStallNs{0};
+  std::atomic<ma_uint64> bytesFetched{0};
+};
+
+// blockSize is rounded up to a multiple of 4096
+void readAheadVfsInit(ReadAheadVfs *pVfs, size_t blockSize, int depth);
+ReadAheadStats readAheadVfsGetStats(const ReadAheadVfs *pVfs);
+
+#endif // READ_AHEAD_VFS_H
@@ -0,0 +1,113 @@
+// Offline render regression check. Renders each fixture through the
+// playback graph with every I/O mode, as --render does, and compares the
+// result with a plain decode of the same file:
+//
+//   ./music_player_rendercheck [fixture ...]
+//
+// With no arguments it checks the bundled "18. Horizon.mp3". Exits non-zero
+// if any render differs, so CI machines without a sound card can run it.
+#include "MusicPlayer.h"
+#include "OfflineRender.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// The graph adds nothing to the signal, but float mixing may round.
+static const float TOLERANCE = 1e-5f;
+
+static bool decodeAll(const std::string &path, std::vector<float> &samples,
+                      ma_uint32 &channels) {
+  ma_decoder_config config = ma_decoder_config_init(ma_format_f32, 0, 0);
+  ma_decoder decoder;
+  if (ma_decoder_init_file(path.c_str(), &config, &decoder) != MA_SUCCESS)
+    return false;
+  ma_decoder_get_data_format(&decoder, NULL, &channels, NULL, NULL, 0);
+  std::vector<float> chunk(4096 * channels);
+  ma_uint64 read = 0;
+  samples.clear();
+  while (ma_decoder_read_pcm_frames(&decoder, chunk.data(), 4096, &read) ==
+             MA_SUCCESS &&
+         read > 0)
+    samples.insert(samples.end(), chunk.begin(),
+                   chunk.begin() + read * channels);
+  ma_decoder_uninit(&decoder);
+  return true;
+}
+
+// Largest sample difference over the samples both have.
+static float maxDifference(const std::vector<float> &expected,
+                           const std::vector<float> &rendered) {
+  size_t count = std::min(expected.size(), rendered.size());
+  float worst = 0.0f;
+  for (size_t i = 0; i < count; ++i)
+    worst = std::max(worst, std::fabs(expected[i] - rendered[i]));
+  return worst;
+}
+
+static bool checkRender(const std::string &path, FileIoMode mode,
+                        const char *modeName,
+                        const std::vector<float> &expected,
+                        ma_uint32 channels) {
+  std::string outPath =
+      (fs::temp_directory_path() / "musical_rendercheck.wav").string();
+  AudioConfig config;
+  config.ioMode = mode;
+  config.periodSizeInFrames = 480;
+  bool ok = renderToFile(path, outPath, config) == 0;
+
+  std::vector<float> rendered;
+  ma_uint32 renderedChannels = 0;
+  if (ok)
+    ok = decodeAll(outPath, rendered, renderedChannels) &&
+         renderedChannels == channels;
+  fs::remove(outPath);
+  if (!ok) {
+    printf("FAIL %s (%s): render failed\n", path.c_str(), modeName);
+    return false;
+  }
+
+  ma_uint64 expectedFrames = expected.size() / channels;
+  ma_uint64 renderedFrames = rendered.size() / channels;
+  float difference = maxDifference(expected, rendered);
+  bool pass = renderedFrames == expectedFrames && difference <= TOLERANCE;
+  printf("%s %s (%s): %llu frames, decode %llu, max error %g\n",
+         pass ? "ok  " : "FAIL", path.c_str(), modeName,
+         (unsigned long long)renderedFrames,
+         (unsigned long long)expectedFrames, difference);
+  return pass;
+}
+
+int main(int argc, char **argv) {
+  std::vector<std::string> fixtures;
+  for (int i = 1; i < argc; ++i)
+    fixtures.push_back(argv[i]);
+  if (fixtures.empty())
+    fixtures.push_back("18. Horizon.mp3");
+
+  const struct {
+    FileIoMode mode;
+    const char *name;
+  } modes[] = {{IO_MMAP, "mmap"}, {IO_STDIO, "stdio"},
+               {IO_READAHEAD, "readahead"}};
+
+  int failures = 0;
+  for (const std::string &path : fixtures) {
+    std::vector<float> expected;
+    ma_uint32 channels = 0;
+    if (!decodeAll(path, expected, channels)) {
+      printf("FAIL %s: cannot decode\n", path.c_str());
+      ++failures;
+      continue;
+    }
+    for (const auto &mode : modes)
+      if (!checkRender(path, mode.mode, mode.name, expected, channels))
+        ++failures;
+  }
+  return failures ? 1 : 0;
+}
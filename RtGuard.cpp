@@ -0,0 +1,246 @@
+#include "RtGuard.h"
+
+#ifdef RT_GUARD
+
+#include <atomic>
+#include <cstdlib>
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <new>
+#include <pthread.h>
+#include <semaphore.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace {
+
+const int MAX_SAMPLES = 32;
+const int MAX_FRAMES = 24;
+
+struct Sample {
+  std::atomic<bool> ready{false};
+  RtViolationKind kind;
+  int depth;
+  void *frames[MAX_FRAMES];
+};
+
+thread_local bool t_realtime = false;
+thread_local bool t_inGuard = false; // Don't count our own bookkeeping
+
+std::atomic<unsigned long long> g_counts[RT_KIND_COUNT];
+std::atomic<int> g_sampleCount{0};
+Sample g_samples[MAX_SAMPLES];
+
+const char *KIND_NAMES[RT_KIND_COUNT] = {
+    "new", "delete", "malloc", "free", "mutex", "semaphore", "sleep", "io"};
+
+inline void checkCall(RtViolationKind kind) {
+  if (!t_realtime || t_inGuard)
+    return;
+  t_inGuard = true;
+  g_counts[kind].fetch_add(1, std::memory_order_relaxed);
+  int slot = g_sampleCount.fetch_add(1, std::memory_order_relaxed);
+  if (slot < MAX_SAMPLES) {
+    Sample &sample = g_samples[slot];
+    sample.kind = kind;
+    sample.depth = backtrace(sample.frames, MAX_FRAMES);
+    sample.ready.store(true, std::memory_order_release);
+  }
+  t_inGuard = false;
+}
+
+// Interposed calls can run before static constructors, so each wrapper
+// resolves the real function on first use.
+template <typename Fn> Fn nextSymbol(Fn &fn, const char *name) {
+  if (fn == nullptr)
+    fn = (Fn)dlsym(RTLD_NEXT, name);
+  return fn;
+}
+
+typedef int (*MutexLockFn)(pthread_mutex_t *);
+typedef int (*SemWaitFn)(sem_t *);
+typedef int (*NanosleepFn)(const struct timespec *, struct timespec *);
+typedef int (*UsleepFn)(useconds_t);
+typedef ssize_t (*ReadFn)(int, void *, size_t);
+typedef ssize_t (*WriteFn)(int, const void *, size_t);
+
+MutexLockFn g_mutexLock;
+SemWaitFn g_semWait;
+NanosleepFn g_nanosleep;
+UsleepFn g_usleep;
+ReadFn g_read;
+WriteFn g_write;
+
+// Resolve everything before any thread is tagged; dlsym may allocate
+struct Resolver {
+  Resolver() { rtGuardInit(); }
+} g_resolver;
+
+} // namespace
+
+void rtGuardInit() {
+  static bool done = false;
+  if (done)
+    return;
+  done = true;
+  nextSymbol(g_mutexLock, "pthread_mutex_lock");
+  nextSymbol(g_semWait, "sem_wait");
+  nextSymbol(g_nanosleep, "nanosleep");
+  nextSymbol(g_usleep, "usleep");
+  nextSymbol(g_read, "read");
+  nextSymbol(g_write, "write");
+
+  // The first backtrace() loads the unwinder, which allocates
+  void *frames[2];
+  backtrace(frames, 2);
+}
+
+RtScope::RtScope() : previous(t_realtime) { t_realtime = true; }
+
+RtScope::~RtScope() { t_realtime = previous; }
+
+unsigned long long rtGuardViolationCount() {
+  unsigned long long total = 0;
+  for (int k = 0; k < RT_KIND_COUNT; ++k)
+    total += g_counts[k].load(std::memory_order_relaxed);
+  return total;
+}
+
+unsigned long long rtGuardViolationCount(RtViolationKind kind) {
+  return g_counts[kind].load(std::memory_order_relaxed);
+}
+
+const char *rtGuardKindName(RtViolationKind kind) { return KIND_NAMES[kind]; }
+
+void rtGuardDump(FILE *out) {
+  t_inGuard = true;
+  fprintf(out, "RT guard: %llu violation(s)\n", rtGuardViolationCount());
+  for (int k = 0; k < RT_KIND_COUNT; ++k) {
+    unsigned long long n = rtGuardViolationCount((RtViolationKind)k);
+    if (n > 0)
+      fprintf(out, "  %-9s %llu\n", KIND_NAMES[k], n);
+  }
+  int samples = g_sampleCount.load(std::memory_order_relaxed);
+  if (samples > MAX_SAMPLES)
+    samples = MAX_SAMPLES;
+  for (int i = 0; i < samples; ++i) {
+    if (!g_samples[i].ready.load(std::memory_order_acquire))
+      continue;
+    fprintf(out, "--- sample %d: %s\n", i, KIND_NAMES[g_samples[i].kind]);
+    fflush(out);
+    backtrace_symbols_fd(g_samples[i].frames, g_samples[i].depth,
+                         fileno(out));
+  }
+  t_inGuard = false;
+}
+
+// --- Heap ---
+
+#if defined(__GLIBC__)
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *p, size_t size);
+void __libc_free(void *p);
+
+void *malloc(size_t size) {
+  checkCall(RT_MALLOC);
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+  checkCall(RT_MALLOC);
+  return __libc_calloc(count, size);
+}
+
+void *realloc(void *p, size_t size) {
+  checkCall(RT_MALLOC);
+  return __libc_realloc(p, size);
+}
+
+void free(void *p) {
+  if (p != NULL)
+    checkCall(RT_FREE);
+  __libc_free(p);
+}
+}
+#endif
+
+// Counted as new/delete, so keep the malloc underneath from counting again
+static void *guardedNew(size_t size) {
+  checkCall(RT_NEW);
+  bool wasInGuard = t_inGuard;
+  t_inGuard = true;
+  void *p = std::malloc(size ? size : 1);
+  t_inGuard = wasInGuard;
+  if (p == nullptr)
+    throw std::bad_alloc();
+  return p;
+}
+
+static void guardedDelete(void *p) {
+  if (p == nullptr)
+    return;
+  checkCall(RT_DELETE);
+  bool wasInGuard = t_inGuard;
+  t_inGuard = true;
+  std::free(p);
+  t_inGuard = wasInGuard;
+}
+
+void *operator new(size_t size) { return guardedNew(size); }
+void *operator new[](size_t size) { return guardedNew(size); }
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+  try {
+    return guardedNew(size);
+  } catch (...) {
+    return nullptr;
+  }
+}
+void *operator new[](size_t size, const std::nothrow_t &) noexcept {
+  try {
+    return guardedNew(size);
+  } catch (...) {
+    return nullptr;
+  }
+}
+void operator delete(void *p) noexcept { guardedDelete(p); }
+void operator delete[](void *p) noexcept { guardedDelete(p); }
+void operator delete(void *p, size_t) noexcept { guardedDelete(p); }
+void operator delete[](void *p, size_t) noexcept { guardedDelete(p); }
+
+// --- Blocking calls ---
+
+extern "C" {
+int pthread_mutex_lock(pthread_mutex_t *mutex) {
+  checkCall(RT_MUTEX);
+  return nextSymbol(g_mutexLock, "pthread_mutex_lock")(mutex);
+}
+
+int sem_wait(sem_t *sem) {
+  checkCall(RT_SEMAPHORE);
+  return nextSymbol(g_semWait, "sem_wait")(sem);
+}
+
+int nanosleep(const struct timespec *req, struct timespec *rem) {
+  checkCall(RT_SLEEP);
+  return nextSymbol(g_nanosleep, "nanosleep")(req, rem);
+}
+
+int usleep(useconds_t usec) {
+  checkCall(RT_SLEEP);
+  return nextSymbol(g_usleep, "usleep")(usec);
+}
+
+ssize_t read(int fd, void *buf, size_t count) {
+  checkCall(RT_IO);
+  return nextSymbol(g_read, "read")(fd, buf, count);
+}
+
+ssize_t write(int fd, const void *buf, size_t count) {
+  checkCall(RT_IO);
+  return nextSymbol(g_write, "write")(fd, buf, count);
+}
+}
+
+#endif // RT_GUARD
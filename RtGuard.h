@@ -0,0 +1,53 @@
+#ifndef RT_GUARD_H
+#define RT_GUARD_H
+
+// Real-time safety checker, compiled in with -DRT_GUARD (make rtcheck).
+//
+// Threads inside an RT_GUARD_SCOPE are treated as the audio thread. While
+// one is, heap use (operator new/delete, malloc and friends) and blocking
+// calls (pthread_mutex_lock, sem_wait, sleeps, read/write) are counted as
+// violations, and the first few are kept with a backtrace. Recording is
+// lock-free and does not allocate.
+//
+// Without RT_GUARD every macro expands to nothing.
+
+#ifdef RT_GUARD
+
+#include <cstdio>
+
+enum RtViolationKind {
+  RT_NEW,
+  RT_DELETE,
+  RT_MALLOC,
+  RT_FREE,
+  RT_MUTEX,
+  RT_SEMAPHORE,
+  RT_SLEEP,
+  RT_IO,
+  RT_KIND_COUNT
+};
+
+class RtScope {
+  bool previous;
+
+public:
+  RtScope();
+  ~RtScope();
+};
+
+void rtGuardInit();
+unsigned long long rtGuardViolationCount();
+unsigned long long rtGuardViolationCount(RtViolationKind kind);
+const char *rtGuardKindName(RtViolationKind kind);
+// Prints counts and the sampled backtraces
+void rtGuardDump(FILE *out);
+
+#define RT_GUARD_SCOPE() RtScope rtScope_
+
+#else
+
+#define RT_GUARD_SCOPE()
+
+#endif // RT_GUARD
+
+#endif // RT_GUARD_H
@@ -0,0 +1,294 @@
+#include "Screen.h"
+#include <algorithm>
+
+// Columns a code point takes up: 2 for East Asian wide and emoji ranges, 0
+// for combining marks (dropped) and 1 for everything else.
+static int glyphWidth(uint32_t c) {
+  if (c < 0x300)
+    return 1;
+  if (c < 0x370 || (c >= 0x200B && c <= 0x200F) ||
+      (c >= 0xFE00 && c <= 0xFE0F))
+    return 0;
+  if ((c >= 0x1100 && c <= 0x115F) || (c >= 0x2E80 && c <= 0xA4CF) ||
+      (c >= 0xAC00 && c <= 0xD7A3) || (c >= 0xF900 && c <= 0xFAFF) ||
+      (c >= 0xFE30 && c <= 0xFE4F) || (c >= 0xFF00 && c <= 0xFF60) ||
+      (c >= 0xFFE0 && c <= 0xFFE6) || (c >= 0x1F300 && c <= 0x1F64F) ||
+      (c >= 0x1F900 && c <= 0x1F9FF) || (c >= 0x20000 && c <= 0x3FFFD))
+    return 2;
+  return 1;
+}
+
+static void appendUtf8(FrameBuffer &out, uint32_t c) {
+  if (c < 0x80) {
+    out.append((char)c);
+  } else if (c < 0x800) {
+    out.append((char)(0xC0 | (c >> 6)));
+    out.append((char)(0x80 | (c & 0x3F)));
+  } else if (c < 0x10000) {
+    out.append((char)(0xE0 | (c >> 12)));
+    out.append((char)(0x80 | ((c >> 6) & 0x3F)));
+    out.append((char)(0x80 | (c & 0x3F)));
+  } else {
+    out.append((char)(0xF0 | (c >> 18)));
+    out.append((char)(0x80 | ((c >> 12) & 0x3F)));
+    out.append((char)(0x80 | ((c >> 6) & 0x3F)));
+    out.append((char)(0x80 | (c & 0x3F)));
+  }
+}
+
+void Screen::resize(int rows, int cols) {
+  rows = std::max(rows, 0);
+  cols = std::max(cols, 0);
+  if (rows == this->rows && cols == this->cols)
+    return;
+  this->rows = rows;
+  this->cols = cols;
+  front.assign((size_t)rows * cols, Cell());
+  back.assign((size_t)rows * cols, Cell());
+  repaint = true;
+}
+
+void Screen::begin() {
+  std::fill(back.begin(), back.end(), Cell());
+  row = 0;
+  col = 0;
+  pen = Cell();
+  pendingBytes = 0;
+  inEscape = false;
+}
+
+void Screen::put(uint32_t glyph) {
+  int width = glyphWidth(glyph);
+  if (width == 0 || row >= rows)
+    return;
+  if (col + width > cols) {
+    // Wrap like the terminal would.
+    ++row;
+    col = 0;
+    if (row >= rows || width > cols)
+      return;
+  }
+  Cell *line = &back[(size_t)row * cols];
+  // Never leave half of a wide glyph behind.
+  if (line[col].glyph == WIDE_TAIL && col > 0)
+    line[col - 1] = Cell();
+  if (col + width < cols && line[col + width].glyph == WIDE_TAIL)
+    line[col + width] = Cell();
+
+  // Blanks look the same in any colour, so they are stored plain and
+  // compare equal to the cleared buffer.
+  Cell cell = glyph == ' ' ? Cell() : pen;
+  cell.glyph = glyph;
+  line[col] = cell;
+  if (width == 2) {
+    cell.glyph = WIDE_TAIL;
+    line[col + 1] = cell;
+  }
+  col += width;
+}
+
+void Screen::sgr(const char *params, size_t size) {
+  size_t i = 0;
+  do {
+    int value = 0;
+    while (i < size && params[i] >= '0' && params[i] <= '9')
+      value = value * 10 + (params[i++] - '0');
+    if (value == 0) {
+      pen = Cell();
+    } else if (value == 1) {
+      pen.bold = true;
+    } else if (value == 22) {
+      pen.bold = false;
+    } else if (value >= 30 && value <= 37) {
+      pen.color = (uint8_t)value;
+    } else if (value == 39) {
+      pen.color = 0;
+    }
+  } while (i < size && params[i++] == ';');
+}
+
+void Screen::write(const char *data, size_t size) {
+  for (size_t i = 0; i < size; ++i) {
+    unsigned char b = (unsigned char)data[i];
+    if (inEscape) {
+      escape += (char)b;
+      if (escape.size() == 1) {
+        inEscape = b == '['; // Only CSI sequences are understood
+      } else if (b >= 0x40 && b <= 0x7E) {
+        inEscape = false;
+        const char *params = escape.data() + 1;
+        size_t length = escape.size() - 2;
+        if (b == 'm') {
+          sgr(params, length);
+        } else if (b == 'H') {
+          row = 0;
+          col = 0;
+        } else if (b == 'J' && length == 1 && params[0] == '2') {
+          std::fill(back.begin(), back.end(), Cell());
+        }
+      } else if (escape.size() > 32) {
+        inEscape = false;
+      }
+      continue;
+    }
+    if (pendingBytes > 0) {
+      if ((b & 0xC0) == 0x80) {
+        codePoint = (codePoint << 6) | (b & 0x3F);
+        if (--pendingBytes == 0)
+          put(codePoint);
+        continue;
+      }
+      pendingBytes = 0;
+      put(0xFFFD); // Truncated sequence; b starts something new
+    }
+
+    if (b == 0x1B) {
+      inEscape = true;
+      escape.clear();
+    } else if (b == '\r') {
+      col = 0;
+    } else if (b == '\n') {
+      ++row;
+      col = 0;
+    } else if (b < 0x20 || b == 0x7F) {
+      // Other control characters draw nothing.
+    } else if (b < 0x80) {
+      put(b);
+    } else if ((b & 0xE0) == 0xC0) {
+      codePoint = b & 0x1F;
+      pendingBytes = 1;
+    } else if ((b & 0xF0) == 0xE0) {
+      codePoint = b & 0x0F;
+      pendingBytes = 2;
+    } else if ((b & 0xF8) == 0xF0) {
+      codePoint = b & 0x07;
+      pendingBytes = 3;
+    } else {
+      put(0xFFFD);
+    }
+  }
+}
+
+// Picks the shortest of the relative and absolute moves that apply.
+void Screen::moveCursor(FrameBuffer &out, int row, int col) {
+  if (cursorRow == row && cursorCol == col)
+    return;
+  if (cursorRow == row && cursorCol >= 0 && col == 0) {
+    out.append('\r');
+  } else if (cursorRow == row && cursorCol >= 0) {
+    out.append("\033[");
+    if (col > cursorCol) {
+      if (col - cursorCol > 1)
+        out.appendNumber(col - cursorCol);
+      out.append('C');
+    } else {
+      if (cursorCol - col > 1)
+        out.appendNumber(cursorCol - col);
+      out.append('D');
+    }
+  } else if (col == 0 && cursorRow >= 0 && row == cursorRow + 1) {
+    out.append("\r\n");
+  } else {
+    out.append("\033[");
+    out.appendNumber(row + 1);
+    if (col > 0) {
+      out.append(';');
+      out.appendNumber(col + 1);
+    }
+    out.append('H');
+  }
+  cursorRow = row;
+  cursorCol = col;
+}
+
+// Adds only the attributes that change; turning bold or a colour off
+// needs a reset, since there is no single code that undoes just a colour.
+void Screen::setStyle(FrameBuffer &out, const Cell &cell) {
+  if (styleKnown && style.color == cell.color && style.bold == cell.bold)
+    return;
+  out.append("\033[");
+  if (!styleKnown || (style.bold && !cell.bold) ||
+      (style.color && !cell.color)) {
+    out.append('0');
+    if (cell.bold)
+      out.append(";1");
+    if (cell.color) {
+      out.append(';');
+      out.appendNumber(cell.color);
+    }
+  } else {
+    if (cell.bold && !style.bold)
+      out.append(cell.color != style.color ? "1;" : "1");
+    if (cell.color != style.color)
+      out.appendNumber(cell.color);
+  }
+  out.append('m');
+  style = cell;
+  styleKnown = true;
+}
+
+void Screen::present(FrameBuffer &out) {
+  if (repaint) {
+    out.append("\033[0m\033[H\033[2J\033[3J");
+    std::fill(front.begin(), front.end(), Cell());
+    cursorRow = 0;
+    cursorCol = 0;
+    style = Cell();
+    styleKnown = true;
+    repaint = false;
+  }
+
+  // Skipping over unchanged cells costs a cursor move of 3+ bytes, so
+  // short stretches of them are rewritten as part of the run instead.
+  const int MAX_GAP = 3;
+  for (int r = 0; r < rows; ++r) {
+    const Cell *next = &back[(size_t)r * cols];
+    const Cell *shown = &front[(size_t)r * cols];
+    int c = 0;
+    while (c < cols) {
+      if (next[c] == shown[c]) {
+        ++c;
+        continue;
+      }
+      int start = c;
+      if (next[start].glyph == WIDE_TAIL && start > 0)
+        --start; // The lead cell draws both halves
+      int end = c + 1;
+      for (;;) {
+        while (end < cols && next[end] != shown[end])
+          ++end;
+        int gap = end;
+        while (gap < cols && gap - end <= MAX_GAP && next[gap] == shown[gap])
+          ++gap;
+        if (gap >= cols || gap - end > MAX_GAP)
+          break;
+        end = gap;
+      }
+      if (end < cols && next[end].glyph == WIDE_TAIL)
+        ++end;
+
+      moveCursor(out, r, start);
+      for (int i = start; i < end; ++i) {
+        if (next[i].glyph == WIDE_TAIL)
+          continue;
+        if (next[i].glyph != ' ')
+          setStyle(out, next[i]);
+        appendUtf8(out, next[i].glyph);
+      }
+      if (end >= cols) {
+        // The cursor waits past the last column; where it goes next
+        // depends on the terminal.
+        cursorRow = -1;
+        cursorCol = -1;
+      } else {
+        cursorCol = end;
+      }
+      c = end;
+    }
+  }
+  if (styleKnown && (style.color || style.bold)) {
+    out.append("\033[0m");
+    style = Cell();
+  }
+  front.swap(back);
+}
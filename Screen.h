@@ -0,0 +1,81 @@
+#ifndef SCREEN_H
+#define SCREEN_H
+
+#include "FrameBuffer.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// One character cell: a code point and the SGR attributes it is drawn with.
+struct Cell {
+  uint32_t glyph = ' '; // WIDE_TAIL for the right half of a wide glyph
+  uint8_t color = 0;    // SGR foreground 30-37, 0 for the default
+  bool bold = false;
+
+  bool operator==(const Cell &other) const {
+    return glyph == other.glyph && color == other.color && bold == other.bold;
+  }
+  bool operator!=(const Cell &other) const { return !(*this == other); }
+};
+
+const uint32_t WIDE_TAIL = 0xFFFFFFFFu;
+
+// Double-buffered cell grid between the UI and the terminal. A frame is
+// written into the back buffer as ordinary terminal output (UTF-8 text,
+// "\r\n" and SGR colour codes); present() then compares it with the front
+// buffer, which mirrors what the terminal shows, and emits only the runs
+// of cells that changed, moving the cursor and switching attributes as
+// little as possible. Long lines wrap as they would on the terminal; rows
+// past the bottom are dropped rather than scrolled.
+class Screen {
+public:
+  // Reallocates both buffers when the size changed; the next present()
+  // then repaints everything.
+  void resize(int rows, int cols);
+  // Starts a frame: blanks the back buffer and homes its cursor.
+  void begin();
+  // Interprets data as a terminal would: printable text is stored at the
+  // cursor, "\r" and "\n" move it, ESC [ ... m sets the attributes and
+  // ESC [ H / ESC [ 2J home and clear. Other sequences are ignored.
+  void write(const char *data, size_t size);
+  void write(const std::string &text) { write(text.data(), text.size()); }
+  // Appends the bytes that turn the front buffer into the back buffer to
+  // out and swaps the buffers. Attributes are reset at the end.
+  void present(FrameBuffer &out);
+  // The terminal was cleared or written to by someone else: repaint
+  // everything on the next present().
+  void invalidate() { repaint = true; }
+
+  int getRows() const { return rows; }
+  int getCols() const { return cols; }
+
+private:
+  void put(uint32_t glyph);
+  void sgr(const char *params, size_t size);
+  void moveCursor(FrameBuffer &out, int row, int col);
+  void setStyle(FrameBuffer &out, const Cell &cell);
+
+  int rows = 0;
+  int cols = 0;
+  std::vector<Cell> front; // What the terminal shows, row-major
+  std::vector<Cell> back;  // The frame being built
+  bool repaint = true;
+
+  // Back buffer writer state
+  int row = 0;
+  int col = 0;
+  Cell pen;
+  uint32_t codePoint = 0; // UTF-8 sequence being decoded
+  int pendingBytes = 0;
+  std::string escape; // Escape sequence being collected
+  bool inEscape = false;
+
+  // Terminal state during present(); -1 when unknown.
+  int cursorRow = -1;
+  int cursorCol = -1;
+  Cell style;
+  bool styleKnown = false;
+};
+
+#endif // SCREEN_H
@@ -0,0 +1,51 @@
+#ifndef SEQ_LOCK_H
+#define SEQ_LOCK_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+// Single-writer, many-reader publication of a small trivially copyable
+// value. Readers never block the writer and never allocate; a read is a
+// handful of relaxed loads, retried only if it raced with a store.
+template <typename T> class SeqLock {
+  static_assert(std::is_trivially_copyable<T>::value,
+                "SeqLock needs a trivially copyable type");
+  static const size_t WORDS = (sizeof(T) + 7) / 8;
+
+  std::atomic<uint64_t> sequence{0};
+  std::atomic<uint64_t> words[WORDS];
+
+public:
+  SeqLock() { store(T()); }
+
+  // Writer thread only
+  void store(const T &value) {
+    uint64_t raw[WORDS] = {};
+    memcpy(raw, &value, sizeof(T));
+    uint64_t seq = sequence.load(std::memory_order_relaxed);
+    sequence.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t i = 0; i < WORDS; ++i)
+      words[i].store(raw[i], std::memory_order_relaxed);
+    sequence.store(seq + 2, std::memory_order_release);
+  }
+
+  T load() const {
+    uint64_t raw[WORDS];
+    uint64_t before, after;
+    do {
+      before = sequence.load(std::memory_order_acquire);
+      for (size_t i = 0; i < WORDS; ++i)
+        raw[i] = words[i].load(std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      after = sequence.load(std::memory_order_relaxed);
+    } while (before != after || (before & 1) != 0);
+    T value;
+    memcpy(&value, raw, sizeof(T));
+    return value;
+  }
+};
+
+#endif // SEQ_LOCK_H
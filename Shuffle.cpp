@@ -0,0 +1,140 @@
+#include "Shuffle.h"
+#include <algorithm>
+#include <chrono>
+#include <random>
+
+const size_t Shuffle::HISTORY;
+const size_t Shuffle::RECENT;
+
+static uint64_t splitMix64(uint64_t &state) {
+  uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+  return z ^ (z >> 31);
+}
+
+Shuffle::Shuffle() {
+  std::random_device device;
+  seed = ((uint64_t)device() << 32) ^ device() ^
+         (uint64_t)std::chrono::steady_clock::now().time_since_epoch().count();
+}
+
+void Shuffle::reset(ShufflePick current) {
+  cycleSize = 0;
+  cyclePos = 0;
+  historyCount = 0;
+  historyEnd = 0;
+  back = 0;
+  deferredCount = 0;
+  if (current.id != NO_TRACK)
+    record(current);
+}
+
+void Shuffle::startCycle(size_t size) {
+  key = splitMix64(seed);
+  cycleSize = size;
+  cyclePos = 0;
+  unsigned bits = 1;
+  while (bits < 64 && (1ull << bits) < size)
+    ++bits;
+  halfBits = (bits + 1) / 2;
+}
+
+// Four Feistel rounds make a bijection on [0, 4^halfBits); indices that
+// land at or past cycleSize are fed back in until one lands inside. The
+// domain is under 4 * cycleSize, so that takes a few rounds at most on
+// average.
+uint64_t Shuffle::permute(uint64_t index) const {
+  uint64_t mask = (1ull << halfBits) - 1;
+  do {
+    uint64_t left = index >> halfBits;
+    uint64_t right = index & mask;
+    for (unsigned round = 0; round < 4; ++round) {
+      uint64_t state = key ^ (right * 0xD6E8FEB86659FD93ull) ^ round;
+      uint64_t next = left ^ (splitMix64(state) & mask);
+      left = right;
+      right = next;
+    }
+    index = (left << halfBits) | right;
+  } while (index >= cycleSize);
+  return index;
+}
+
+bool Shuffle::isRecent(TrackId id, size_t window) const {
+  size_t count = std::min(window, historyCount);
+  for (size_t i = 1; i <= count; ++i) {
+    if (history[(historyEnd + HISTORY - i) % HISTORY].id == id)
+      return true;
+  }
+  return false;
+}
+
+void Shuffle::record(ShufflePick pick) {
+  history[historyEnd] = pick;
+  historyEnd = (historyEnd + 1) % HISTORY;
+  historyCount = std::min(historyCount + 1, HISTORY);
+  back = 0;
+}
+
+// Removes and records the oldest held-back track.
+ShufflePick Shuffle::takeDeferred() {
+  ShufflePick pick = deferred[0];
+  std::copy(deferred + 1, deferred + deferredCount, deferred);
+  --deferredCount;
+  record(pick);
+  return pick;
+}
+
+ShufflePick Shuffle::next(const std::vector<TrackId> &order) {
+  // Forward again through tracks previous() went back over.
+  if (back > 0) {
+    --back;
+    return history[(historyEnd + HISTORY - 1 - back) % HISTORY];
+  }
+  if (order.empty())
+    return ShufflePick();
+
+  // Never hold back more than half the list, or a short list would run
+  // out of tracks to play.
+  size_t window = std::min(RECENT, order.size() / 2);
+  if (deferredCount > 0 && !isRecent(deferred[0].id, window))
+    return takeDeferred();
+
+  for (size_t attempts = 0; attempts <= 2 * order.size() + RECENT;
+       ++attempts) {
+    if (cyclePos >= cycleSize)
+      startCycle(order.size());
+    ShufflePick pick;
+    pick.position = permute(cyclePos++);
+    if (pick.position >= order.size())
+      continue; // Removed since the cycle started
+    pick.id = order[pick.position];
+    // Held back from the previous cycle; it counts for this one too.
+    if (std::any_of(deferred, deferred + deferredCount,
+                    [&](const ShufflePick &held) {
+                      return held.position == pick.position;
+                    }))
+      continue;
+    if (!isRecent(pick.id, window)) {
+      record(pick);
+      return pick;
+    }
+    if (deferredCount < RECENT)
+      deferred[deferredCount++] = pick;
+  }
+
+  // Everything left is recent: play the oldest held-back track anyway.
+  if (deferredCount > 0)
+    return takeDeferred();
+  ShufflePick pick;
+  pick.id = order[0];
+  record(pick);
+  return pick;
+}
+
+ShufflePick Shuffle::previous() {
+  if (back + 1 >= historyCount)
+    return ShufflePick();
+  ++back;
+  return history[(historyEnd + HISTORY - 1 - back) % HISTORY];
+}
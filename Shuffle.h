@@ -0,0 +1,72 @@
+#ifndef SHUFFLE_H
+#define SHUFFLE_H
+
+#include "TrackList.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// A track drawn by Shuffle and its index in the order it came from, which
+// tells apart repeated playlist entries.
+struct ShufflePick {
+  TrackId id = NO_TRACK;
+  size_t position = 0;
+};
+
+// Shuffled play order in constant memory. Each cycle visits every list
+// position once, in the order of a keyed Feistel permutation of the
+// indices: position i of the cycle is computed on demand instead of being
+// stored in an O(N) array. A new key starts the next cycle.
+//
+// Played tracks go into a fixed ring, so previous() can step back through
+// them and next() forward again before drawing new ones. A track played
+// within the last RECENT draws is held back until it falls out of that
+// window, which keeps a new cycle from repeating the end of the previous
+// one.
+//
+// A cycle covers the list as it was when the cycle started. Tracks added
+// later join the next cycle; if tracks are removed mid-cycle, positions
+// shift and a few tracks may be skipped or repeated until it ends.
+class Shuffle {
+public:
+  static const size_t HISTORY = 256;
+  static const size_t RECENT = 32;
+
+  Shuffle();
+
+  // Starts a fresh cycle with current as the only history entry.
+  void reset(ShufflePick current);
+  // Next track to play from order (the library or a playlist), with an id
+  // of NO_TRACK if it is empty.
+  ShufflePick next(const std::vector<TrackId> &order);
+  // The track played before the current one, with an id of NO_TRACK at the
+  // start of the history.
+  ShufflePick previous();
+  // Adds a track played by other means (search) to the history.
+  void record(ShufflePick pick);
+
+private:
+  uint64_t permute(uint64_t index) const;
+  void startCycle(size_t size);
+  bool isRecent(TrackId id, size_t window) const;
+  ShufflePick takeDeferred();
+
+  uint64_t seed;
+  // Current cycle: a Feistel network over halfBits * 2 bits, walked until
+  // it lands below cycleSize.
+  uint64_t key = 0;
+  unsigned halfBits = 0;
+  size_t cycleSize = 0;
+  size_t cyclePos = 0;
+
+  ShufflePick history[HISTORY];
+  size_t historyCount = 0; // Valid entries, ending at historyEnd - 1
+  size_t historyEnd = 0;   // Ring index after the newest entry
+  size_t back = 0;         // Steps previous() has gone back from the newest
+
+  // Drawn while still recent; played once they age out.
+  ShufflePick deferred[RECENT];
+  size_t deferredCount = 0;
+};
+
+#endif // SHUFFLE_H
@@ -12,72 +12,76 @@
 // truth.
 #include "VisualizerNode.h"
 
-std::string formatTime(float seconds) {
+void appendTime(FrameBuffer &out, float seconds) {
   int m = static_cast<int>(seconds) / 60;
   int s = static_cast<int>(seconds) % 60;
-  char buffer[16];
-  snprintf(buffer, sizeof(buffer), "%02d:%02d", m, s);
-  return std::string(buffer);
+  out.appendf("%02d:%02d", m, s);
 }
 
-std::string drawProgressBar(float current, float total, int width) {
-  if (total <= 0.0f)
-    return std::string(" [") + std::string(width, ' ') + "] 00:00 / 00:00";
+// Like appendTime, with an hours field once the total reaches an hour.
+void appendDuration(FrameBuffer &out, double seconds) {
+  long total = static_cast<long>(seconds);
+  if (total < 3600) {
+    appendTime(out, static_cast<float>(seconds));
+    return;
+  }
+  out.appendf("%ld:%02ld:%02ld", total / 3600, (total / 60) % 60, total % 60);
+}
 
+int progressCells(float current, float total, int width) {
+  if (total <= 0.0f)
+    return 0;
   float progress = std::min(std::max(current / total, 0.0f), 1.0f);
-  int pos = static_cast<int>(progress * width);
+  return std::min(static_cast<int>(progress * width), width);
+}
 
-  std::string bar = "[";
-  bar += COLOR_CYAN;
-  for (int i = 0; i < width; ++i) {
-    if (i < pos)
-      bar += "\u2588"; // Full Block
-    else if (i == pos)
-      bar += "\u2592"; // Medium Shade
-    else
-      bar += " ";
-  }
-  bar += COLOR_RESET;
-  bar += "] " + formatTime(current) + " / " + formatTime(total);
-  return bar;
+int barRows(float value, int height) {
+  // Normalized height approx.
+  return static_cast<int>(std::min(value * height, (float)height));
 }
 
-std::string drawVolumeBar(float volume, int width) {
-  int pos = static_cast<int>(volume * width);
-  std::string bar = "[";
-  bar += COLOR_GREEN;
-  for (int i = 0; i < width; ++i) {
-    if (i < pos)
-      bar += "\u2588";
-    else
-      bar += " ";
+void drawProgressBar(FrameBuffer &out, float current, float total, int width) {
+  if (total <= 0.0f) {
+    out.append(" [");
+    out.repeat(" ", width);
+    out.append("] 00:00 / 00:00");
+    return;
   }
-  bar += COLOR_RESET;
-  bar += "] " + std::to_string(static_cast<int>(volume * 100)) + "%";
-  return bar;
+
+  int pos = progressCells(current, total, width);
+
+  out.append("[" COLOR_CYAN);
+  out.repeat("\u2588", pos); // Full Block
+  if (pos < width) {
+    out.append("\u2592"); // Medium Shade
+    out.repeat(" ", width - pos - 1);
+  }
+  out.append(COLOR_RESET "] ");
+  appendTime(out, current);
+  out.append(" / ");
+  appendTime(out, total);
 }
 
-void drawVisualizer(std::ostream &out, const std::vector<float> &bars,
-                    int height) {
-  // out << "\r\n"; // Removed spacer
+void drawVolumeBar(FrameBuffer &out, float volume, int width) {
+  int pos = std::min(std::max(static_cast<int>(volume * width), 0), width);
+  out.append("[" COLOR_GREEN);
+  out.repeat("\u2588", pos);
+  out.repeat(" ", width - pos);
+  out.append(COLOR_RESET "] ");
+  out.appendNumber(static_cast<int>(volume * 100));
+  out.append('%');
+}
 
+void drawVisualizer(FrameBuffer &out, const std::vector<float> &bars,
+                    int height) {
   for (int h = height; h > 0; --h) {
-    out << "  "; // Margin
-    for (float val : bars) {
-      // Normalized height approx.
-      int barHeight = static_cast<int>(std::min(val * height, (float)height));
-
-      if (h <= barHeight) {
-        out << COLOR_GREEN << "\u2588 " << COLOR_RESET;
-      } else {
-        out << "  ";
-      }
-    }
-    out << "\r\n";
+    out.append("  " COLOR_GREEN); // Margin
+    for (float val : bars)
+      out.append(h <= barRows(val, height) ? "\u2588 " : "  ");
+    out.append(COLOR_RESET "\r\n");
   }
   // Bottom line
-  out << "  ";
-  for (int i = 0; i < NUM_BARS; ++i)
-    out << "--";
-  out << "\r\n\r\n";
+  out.append("  ");
+  out.repeat("--", NUM_BARS);
+  out.append("\r\n\r\n");
 }
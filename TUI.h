@@ -1,8 +1,7 @@
 #ifndef TUI_H
 #define TUI_H
 
-#include <iostream>
-#include <string>
+#include "FrameBuffer.h"
 #include <vector>
 
 // --- Colors & Styles ---
@@ -16,10 +15,17 @@
 #define COLOR_CYAN "\033[36m"
 #define COLOR_WHITE "\033[37m"
 
-std::string formatTime(float seconds);
-std::string drawProgressBar(float current, float total, int width);
-std::string drawVolumeBar(float volume, int width);
-void drawVisualizer(std::ostream &out, const std::vector<float> &bars,
+// Everything below appends to the frame instead of returning a string, so
+// a frame is built without allocating.
+void appendTime(FrameBuffer &out, float seconds);
+// Filled cells of a progress bar and rows of a visualizer bar, as drawn;
+// the frame scheduler compares these to skip frames that look the same.
+int progressCells(float current, float total, int width);
+int barRows(float value, int height);
+void appendDuration(FrameBuffer &out, double seconds);
+void drawProgressBar(FrameBuffer &out, float current, float total, int width);
+void drawVolumeBar(FrameBuffer &out, float volume, int width);
+void drawVisualizer(FrameBuffer &out, const std::vector<float> &bars,
                     int height);
 
 #endif // TUI_H
@@ -0,0 +1,275 @@
+#include "TagIndex.h"
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+
+static inline bool isWordByte(unsigned char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+         (c >= '0' && c <= '9') || c >= 0x80;
+}
+
+// Calls emit with each lowercased word of text. Bytes of multi-byte UTF-8
+// characters count as word bytes and are kept as they are.
+template <typename Emit>
+static void forEachWord(const char *text, size_t size, Emit emit) {
+  std::string word;
+  for (size_t i = 0; i <= size; ++i) {
+    unsigned char c = i < size ? (unsigned char)text[i] : ' ';
+    if (isWordByte(c)) {
+      word += (c >= 'A' && c <= 'Z') ? (char)(c - 'A' + 'a') : (char)c;
+    } else if (!word.empty()) {
+      emit(word);
+      word.clear();
+    }
+  }
+}
+
+static void putVarint(std::vector<uint8_t> &out, uint32_t value) {
+  while (value >= 0x80) {
+    out.push_back((uint8_t)(value | 0x80));
+    value >>= 7;
+  }
+  out.push_back((uint8_t)value);
+}
+
+static inline const uint8_t *getVarint(const uint8_t *p, uint32_t &value) {
+  value = 0;
+  for (int shift = 0;; shift += 7) {
+    uint8_t byte = *p++;
+    value |= (uint32_t)(byte & 0x7F) << shift;
+    if (!(byte & 0x80))
+      return p;
+  }
+}
+
+// The index is rebuilt once this many changed tracks, or an eighth of the
+// indexed ones if more, have to be matched one by one.
+static const size_t CHANGED_MIN = 1024;
+
+void TagIndex::sync(const TrackList &tracks) {
+  if (&tracks == source && tracks.getVersion() == syncedVersion)
+    return;
+  if (&tracks == source && tracks.changedSince(syncedVersion, changed)) {
+    std::sort(changed.begin(), changed.end());
+    changed.erase(std::unique(changed.begin(), changed.end()), changed.end());
+    if (changed.size() <= std::max(CHANGED_MIN, indexedCount / 8)) {
+      syncedVersion = tracks.getVersion();
+      return;
+    }
+  }
+  rebuild(tracks);
+}
+
+void TagIndex::rebuild(const TrackList &tracks) {
+  source = &tracks;
+  syncedVersion = tracks.getVersion();
+  indexedCount = tracks.size();
+  changed.clear();
+
+  // TrackList interns tag values, so a repeated artist, album or genre is
+  // the same string object and is split into words only once per field.
+  std::unordered_map<std::string, uint32_t> termIds;
+  std::vector<std::vector<TrackId>> lists;
+  std::unordered_map<const std::string *, std::vector<uint32_t>>
+      valueTerms[TAG_FIELD_COUNT];
+  std::string key;
+  for (size_t i = 0; i < tracks.size(); ++i) {
+    TrackId id = tracks.at(i);
+    for (int f = 0; f < TAG_FIELD_COUNT; ++f) {
+      const std::string &value = tracks.tag(id, (TagField)f);
+      if (value.empty())
+        continue;
+      auto cached = valueTerms[f].emplace(&value, std::vector<uint32_t>());
+      std::vector<uint32_t> &words = cached.first->second;
+      if (cached.second) {
+        forEachWord(value.data(), value.size(), [&](const std::string &word) {
+          key.assign(1, (char)('0' + f));
+          key += word;
+          auto term = termIds.emplace(key, (uint32_t)lists.size());
+          if (term.second)
+            lists.emplace_back();
+          words.push_back(term.first->second);
+        });
+      }
+      for (uint32_t term : words)
+        lists[term].push_back(id);
+    }
+  }
+
+  terms.clear();
+  postings.clear();
+  std::vector<uint32_t> byKey(lists.size());
+  terms.resize(lists.size());
+  for (auto &entry : termIds) {
+    terms[entry.second].key = entry.first;
+    byKey[entry.second] = entry.second;
+  }
+  std::sort(byKey.begin(), byKey.end(), [&](uint32_t a, uint32_t b) {
+    return terms[a].key < terms[b].key;
+  });
+
+  // Id gaps are small within a term, so most deltas fit in one byte.
+  std::vector<Term> sorted(terms.size());
+  for (size_t t = 0; t < byKey.size(); ++t) {
+    Term &term = sorted[t];
+    term.key.swap(terms[byKey[t]].key);
+    std::vector<TrackId> &ids = lists[byKey[t]];
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    term.offset = postings.size();
+    term.count = (uint32_t)ids.size();
+    TrackId previous = 0;
+    for (TrackId id : ids) {
+      putVarint(postings, id - previous);
+      previous = id;
+    }
+  }
+  terms.swap(sorted);
+}
+
+bool TagIndex::isTagQuery(const std::string &query) {
+  for (size_t i = 0; i < query.size(); ++i) {
+    if (i > 0 && query[i - 1] != ' ')
+      continue;
+    for (int f = 0; f < TAG_FIELD_COUNT; ++f) {
+      size_t length = strlen(TAG_FIELD_NAMES[f]);
+      if (query.compare(i, length, TAG_FIELD_NAMES[f]) == 0 &&
+          i + length < query.size() && query[i + length] == ':')
+        return true;
+    }
+  }
+  return false;
+}
+
+void TagIndex::collect(const std::string &prefix,
+                       std::vector<TrackId> &out) const {
+  auto it = std::lower_bound(
+      terms.begin(), terms.end(), prefix,
+      [](const Term &term, const std::string &key) { return term.key < key; });
+  size_t before = out.size();
+  size_t matched = 0;
+  for (; it != terms.end() && it->key.compare(0, prefix.size(), prefix) == 0;
+       ++it) {
+    const uint8_t *p = postings.data() + it->offset;
+    TrackId id = 0;
+    for (uint32_t i = 0; i < it->count; ++i) {
+      uint32_t delta;
+      p = getVarint(p, delta);
+      id += delta;
+      out.push_back(id);
+    }
+    ++matched;
+  }
+  // A single term's list is already sorted; a union of several is not.
+  if (matched > 1 || before > 0) {
+    std::sort(out.begin(), out.end());
+    out.erase(std::unique(out.begin(), out.end()), out.end());
+  }
+}
+
+void TagIndex::match(int field, const std::string &word,
+                     std::vector<TrackId> &out) const {
+  for (int f = 0; f < TAG_FIELD_COUNT; ++f) {
+    if (field < 0 || field == f)
+      collect(std::string(1, (char)('0' + f)) + word, out);
+  }
+  if (changed.empty())
+    return;
+
+  auto isChanged = [&](TrackId id) {
+    return std::binary_search(changed.begin(), changed.end(), id);
+  };
+  out.erase(std::remove_if(out.begin(), out.end(), isChanged), out.end());
+  size_t middle = out.size();
+  for (TrackId id : changed) {
+    if (!source->isListed(id))
+      continue;
+    bool found = false;
+    for (int f = 0; f < TAG_FIELD_COUNT && !found; ++f) {
+      if (field >= 0 && field != f)
+        continue;
+      const std::string &value = source->tag(id, (TagField)f);
+      forEachWord(value.data(), value.size(), [&](const std::string &each) {
+        found = found || each.compare(0, word.size(), word) == 0;
+      });
+    }
+    if (found)
+      out.push_back(id);
+  }
+  std::inplace_merge(out.begin(), out.begin() + middle, out.end());
+}
+
+// Keeps the ids of result that are also in other; both are sorted.
+static void intersect(std::vector<TrackId> &result,
+                      const std::vector<TrackId> &other) {
+  size_t kept = 0;
+  auto from = other.begin();
+  for (TrackId id : result) {
+    // Galloping would pay off for very uneven lists; lower_bound from the
+    // last position is close enough and stays simple.
+    from = std::lower_bound(from, other.end(), id);
+    if (from == other.end())
+      break;
+    if (*from == id)
+      result[kept++] = id;
+  }
+  result.resize(kept);
+}
+
+void TagIndex::query(const std::string &query,
+                     std::vector<TrackId> &out) const {
+  out.clear();
+  // Split into (field, text) pieces; field -1 matches any field.
+  std::vector<std::pair<int, std::string>> pieces;
+  int field = -1;
+  size_t i = 0;
+  while (i < query.size()) {
+    if (query[i] == ' ') {
+      ++i;
+      continue;
+    }
+    size_t colon = query.find(':', i);
+    size_t space = query.find(' ', i);
+    if (colon != std::string::npos && colon < space) {
+      for (int f = 0; f < TAG_FIELD_COUNT; ++f) {
+        if (query.compare(i, colon - i, TAG_FIELD_NAMES[f]) == 0) {
+          field = f;
+          i = colon + 1;
+          break;
+        }
+      }
+    }
+    size_t end;
+    if (i < query.size() && query[i] == '"') {
+      end = query.find('"', i + 1);
+      if (end == std::string::npos)
+        end = query.size();
+      pieces.emplace_back(field, query.substr(i + 1, end - i - 1));
+      ++end;
+    } else {
+      end = std::min(query.find(' ', i), query.size());
+      pieces.emplace_back(field, query.substr(i, end - i));
+    }
+    i = end;
+  }
+
+  std::vector<std::vector<TrackId>> lists;
+  for (const auto &piece : pieces) {
+    forEachWord(piece.second.data(), piece.second.size(),
+                [&](const std::string &word) {
+                  lists.emplace_back();
+                  match(piece.first, word, lists.back());
+                });
+  }
+  if (lists.empty())
+    return;
+
+  // Smallest list first, so each step scans as little as possible.
+  std::sort(lists.begin(), lists.end(),
+            [](const std::vector<TrackId> &a, const std::vector<TrackId> &b) {
+              return a.size() < b.size();
+            });
+  out.swap(lists[0]);
+  for (size_t l = 1; l < lists.size() && !out.empty(); ++l)
+    intersect(out, lists[l]);
+}
@@ -0,0 +1,62 @@
+#ifndef TAG_INDEX_H
+#define TAG_INDEX_H
+
+#include "TrackList.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Inverted index over the playlist's tags: every word of every tag field
+// maps to the sorted ids of the tracks containing it. Posting lists are
+// stored delta-encoded as varints in one buffer, so even a large library's
+// index stays a few bytes per track and word.
+//
+// Queries are space-separated words, each optionally prefixed by a field:
+//   artist:floyd album:wall     genre:jazz miles     artist:"pink floyd"
+// Words following a field keep that field until the next one; words
+// before any field match every field. Every word matches as a prefix and
+// all words must match, so a query is a handful of posting-list
+// intersections rather than a scan over the tracks.
+//
+// Tracks changed after the index was built are kept aside and matched
+// directly against their tags, so a watcher batch costs a few ids rather
+// than a rebuild; the index is rebuilt once they outgrow a fraction of it.
+class TagIndex {
+public:
+  // Catches up with tracks, which must outlive the index.
+  void sync(const TrackList &tracks);
+
+  // True if query names a field ("artist:..."), the cue to use this index
+  // instead of path search.
+  static bool isTagQuery(const std::string &query);
+
+  // Tracks matching every word of query, in ascending id order.
+  void query(const std::string &query, std::vector<TrackId> &out) const;
+
+  size_t getTermCount() const { return terms.size(); }
+  size_t getPostingBytes() const { return postings.size(); }
+
+private:
+  struct Term {
+    std::string key; // Field digit, then the lowercased word
+    uint64_t offset; // Into postings
+    uint32_t count;
+  };
+
+  void rebuild(const TrackList &tracks);
+  // Appends the ids of every term starting with prefix, sorted and unique.
+  void collect(const std::string &prefix, std::vector<TrackId> &out) const;
+  // Ids in out listed for word in field (-1 for any), with those of changed
+  // tracks replaced by a check of their current tags.
+  void match(int field, const std::string &word,
+             std::vector<TrackId> &out) const;
+
+  std::vector<Term> terms; // Sorted by key
+  std::vector<uint8_t> postings;
+  size_t indexedCount = 0;
+  uint64_t syncedVersion = ~0ull;
+  const TrackList *source = nullptr;
+  std::vector<TrackId> changed; // Sorted; their postings may be out of date
+};
+
+#endif // TAG_INDEX_H
@@ -0,0 +1,437 @@
+#include "TagReader.h"
+#include "AudioProbe.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+const char *const TAG_FIELD_NAMES[TAG_FIELD_COUNT] = {"title", "artist",
+                                                      "album", "genre"};
+
+// Longest value kept for one field; longer ones are cut.
+static const size_t MAX_FIELD_BYTES = 1024;
+// Largest FLAC VORBIS_COMMENT block read when it lies past the head.
+static const size_t MAX_COMMENT_BYTES = 1 << 20;
+
+bool TrackTags::empty() const {
+  for (const auto &value : field)
+    if (!value.empty())
+      return false;
+  return true;
+}
+
+static uint32_t readBE24(const unsigned char *p) {
+  return ((uint32_t)p[0] << 16) | ((uint32_t)p[1] << 8) | p[2];
+}
+
+static uint32_t readBE32(const unsigned char *p) {
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+         ((uint32_t)p[2] << 8) | p[3];
+}
+
+static uint32_t readLE32(const unsigned char *p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) |
+         ((uint32_t)p[3] << 24);
+}
+
+static uint32_t readSyncsafe(const unsigned char *p) {
+  return ((uint32_t)(p[0] & 0x7F) << 21) | ((uint32_t)(p[1] & 0x7F) << 14) |
+         ((uint32_t)(p[2] & 0x7F) << 7) | (p[3] & 0x7F);
+}
+
+// The start and end of the file are read up front; anything else costs a
+// pread, if there is a file to read from. It is opened on the first such
+// read, so most files are parsed without one.
+struct TagSource {
+  const char *path;
+  uint64_t fileSize;
+  const unsigned char *head;
+  size_t headSize;
+  const unsigned char *tail;
+  size_t tailSize;
+  mutable int fd = -1;
+  mutable bool opened = false;
+
+  ~TagSource() {
+    if (fd >= 0)
+      close(fd);
+  }
+
+  bool read(uint64_t offset, unsigned char *out, size_t size) const {
+    if (offset + size > fileSize)
+      return false;
+    if (offset + size <= headSize) {
+      memcpy(out, head + offset, size);
+      return true;
+    }
+    if (offset >= fileSize - tailSize) {
+      memcpy(out, tail + (offset - (fileSize - tailSize)), size);
+      return true;
+    }
+    if (!opened && path) {
+      fd = open(path, O_RDONLY | O_CLOEXEC);
+      opened = true;
+    }
+    return fd >= 0 && pread(fd, out, size, offset) == (ssize_t)size;
+  }
+};
+
+static void appendUtf8(std::string &out, uint32_t code) {
+  if (code < 0x80) {
+    out += (char)code;
+  } else if (code < 0x800) {
+    out += (char)(0xC0 | (code >> 6));
+    out += (char)(0x80 | (code & 0x3F));
+  } else if (code < 0x10000) {
+    out += (char)(0xE0 | (code >> 12));
+    out += (char)(0x80 | ((code >> 6) & 0x3F));
+    out += (char)(0x80 | (code & 0x3F));
+  } else {
+    out += (char)(0xF0 | (code >> 18));
+    out += (char)(0x80 | ((code >> 12) & 0x3F));
+    out += (char)(0x80 | ((code >> 6) & 0x3F));
+    out += (char)(0x80 | (code & 0x3F));
+  }
+}
+
+// Strips the padding tags are often written with.
+static void trim(std::string &value) {
+  size_t end = value.find_last_not_of(" \t\r\n");
+  value.erase(end == std::string::npos ? 0 : end + 1);
+  size_t begin = value.find_first_not_of(" \t\r\n");
+  value.erase(0, begin == std::string::npos ? value.size() : begin);
+  if (value.size() > MAX_FIELD_BYTES)
+    value.resize(MAX_FIELD_BYTES);
+}
+
+// --- ID3 ---
+
+// Standard ID3v1 genres, which ID3v2 TCON frames may refer to as "(n)".
+static const char *const ID3_GENRES[] = {
+    "Blues", "Classic Rock", "Country", "Dance", "Disco", "Funk", "Grunge",
+    "Hip-Hop", "Jazz", "Metal", "New Age", "Oldies", "Other", "Pop", "R&B",
+    "Rap", "Reggae", "Rock", "Techno", "Industrial", "Alternative", "Ska",
+    "Death Metal", "Pranks", "Soundtrack", "Euro-Techno", "Ambient",
+    "Trip-Hop", "Vocal", "Jazz+Funk", "Fusion", "Trance", "Classical",
+    "Instrumental", "Acid", "House", "Game", "Sound Clip", "Gospel", "Noise",
+    "Alternative Rock", "Bass", "Soul", "Punk", "Space", "Meditative",
+    "Instrumental Pop", "Instrumental Rock", "Ethnic", "Gothic", "Darkwave",
+    "Techno-Industrial", "Electronic", "Pop-Folk", "Eurodance", "Dream",
+    "Southern Rock", "Comedy", "Cult", "Gangsta", "Top 40", "Christian Rap",
+    "Pop/Funk", "Jungle", "Native American", "Cabaret", "New Wave",
+    "Psychedelic", "Rave", "Showtunes", "Trailer", "Lo-Fi", "Tribal",
+    "Acid Punk", "Acid Jazz", "Polka", "Retro", "Musical", "Rock & Roll",
+    "Hard Rock"};
+static const size_t ID3_GENRE_COUNT =
+    sizeof(ID3_GENRES) / sizeof(ID3_GENRES[0]);
+
+// "(17)", "17" or "(17)Rock" become "Rock"; anything else is kept.
+static void resolveGenre(std::string &genre) {
+  size_t i = genre.size() > 0 && genre[0] == '(' ? 1 : 0;
+  size_t digits = i;
+  while (digits < genre.size() && genre[digits] >= '0' && genre[digits] <= '9')
+    ++digits;
+  if (digits == i || digits - i > 3)
+    return;
+  bool closed = i == 0 ? digits == genre.size()
+                       : digits < genre.size() && genre[digits] == ')';
+  if (!closed)
+    return;
+  size_t rest = i == 0 ? digits : digits + 1;
+  if (rest < genre.size()) {
+    // A refinement after the reference names the genre itself.
+    genre.erase(0, rest);
+    return;
+  }
+  size_t number = std::stoul(genre.substr(i, digits - i));
+  genre = number < ID3_GENRE_COUNT ? ID3_GENRES[number] : "";
+}
+
+// Decodes an ID3v2 text frame body: an encoding byte, then the text. Only
+// the first of several NUL-separated values is kept.
+static std::string decodeId3Text(const unsigned char *p, size_t size) {
+  std::string out;
+  if (size < 1)
+    return out;
+  unsigned char encoding = p[0];
+  ++p;
+  --size;
+  if (encoding == 0 || encoding == 3) {
+    // Latin-1 or UTF-8.
+    for (size_t i = 0; i < size && p[i]; ++i) {
+      if (encoding == 0)
+        appendUtf8(out, p[i]);
+      else
+        out += (char)p[i];
+    }
+  } else if (encoding == 1 || encoding == 2) {
+    // UTF-16 with a BOM, or big-endian without one.
+    bool bigEndian = encoding == 2;
+    size_t i = 0;
+    if (encoding == 1 && size >= 2) {
+      bigEndian = p[0] == 0xFE && p[1] == 0xFF;
+      i = 2;
+    }
+    for (; i + 1 < size; i += 2) {
+      uint32_t unit = bigEndian ? (p[i] << 8) | p[i + 1] : p[i] | (p[i + 1] << 8);
+      if (unit == 0)
+        break;
+      if (unit >= 0xD800 && unit < 0xDC00 && i + 3 < size) {
+        uint32_t low = bigEndian ? (p[i + 2] << 8) | p[i + 3]
+                                 : p[i + 2] | (p[i + 3] << 8);
+        if (low >= 0xDC00 && low < 0xE000) {
+          unit = 0x10000 + ((unit - 0xD800) << 10) + (low - 0xDC00);
+          i += 2;
+        }
+      }
+      appendUtf8(out, unit);
+    }
+  }
+  trim(out);
+  return out;
+}
+
+static int id3FrameField(const char *id, int major) {
+  static const char *const V22[TAG_FIELD_COUNT] = {"TT2", "TP1", "TAL",
+                                                   "TCO"};
+  static const char *const V23[TAG_FIELD_COUNT] = {"TIT2", "TPE1", "TALB",
+                                                   "TCON"};
+  for (int f = 0; f < TAG_FIELD_COUNT; ++f) {
+    if (major == 2 ? memcmp(id, V22[f], 3) == 0 : memcmp(id, V23[f], 4) == 0)
+      return f;
+  }
+  return -1;
+}
+
+static bool readId3v2(const TagSource &source, TrackTags &tags) {
+  unsigned char header[10];
+  if (!source.read(0, header, sizeof(header)) ||
+      memcmp(header, "ID3", 3) != 0)
+    return false;
+  int major = header[3];
+  if (major < 2 || major > 4)
+    return false;
+  uint64_t end = 10 + (uint64_t)readSyncsafe(header + 6);
+  uint64_t pos = 10;
+  if (major >= 3 && (header[5] & 0x40)) {
+    // Extended header; v2.3 does not count its own size field.
+    unsigned char ext[4];
+    if (!source.read(pos, ext, 4))
+      return false;
+    pos += major == 4 ? readSyncsafe(ext) : readBE32(ext) + 4;
+  }
+
+  size_t headerSize = major == 2 ? 6 : 10;
+  bool found = false;
+  std::vector<unsigned char> body;
+  while (pos + headerSize <= end) {
+    unsigned char frame[10];
+    if (!source.read(pos, frame, headerSize) || frame[0] == 0)
+      break; // Padding
+    uint32_t size = major == 2   ? readBE24(frame + 3)
+                    : major == 4 ? readSyncsafe(frame + 4)
+                                 : readBE32(frame + 4);
+    pos += headerSize;
+    if (pos + size > end)
+      break;
+    int field = id3FrameField((const char *)frame, major);
+    // Compressed or encrypted frames are skipped.
+    bool packed = major == 3   ? (frame[9] & 0xC0) != 0
+                  : major == 4 ? (frame[9] & 0x0C) != 0
+                               : false;
+    if (field >= 0 && !packed && tags.field[field].empty()) {
+      body.resize(std::min<size_t>(size, MAX_FIELD_BYTES * 2 + 3));
+      if (source.read(pos, body.data(), body.size())) {
+        tags.field[field] = decodeId3Text(body.data(), body.size());
+        if (field == TAG_GENRE)
+          resolveGenre(tags.field[field]);
+        found = found || !tags.field[field].empty();
+      }
+    }
+    pos += size;
+  }
+  return found;
+}
+
+static std::string latin1Field(const unsigned char *p, size_t size) {
+  std::string out;
+  for (size_t i = 0; i < size && p[i]; ++i)
+    appendUtf8(out, p[i]);
+  trim(out);
+  return out;
+}
+
+static bool readId3v1(const TagSource &source, TrackTags &tags) {
+  unsigned char tag[128];
+  if (source.fileSize < sizeof(tag) ||
+      !source.read(source.fileSize - sizeof(tag), tag, sizeof(tag)) ||
+      memcmp(tag, "TAG", 3) != 0)
+    return false;
+  std::string values[TAG_FIELD_COUNT] = {
+      latin1Field(tag + 3, 30), latin1Field(tag + 33, 30),
+      latin1Field(tag + 63, 30),
+      tag[127] < ID3_GENRE_COUNT ? ID3_GENRES[tag[127]] : ""};
+  for (int f = 0; f < TAG_FIELD_COUNT; ++f) {
+    if (tags.field[f].empty())
+      tags.field[f] = values[f];
+  }
+  return !tags.empty();
+}
+
+// --- Vorbis comments ---
+
+// Parses a Vorbis comment block (vendor string, then KEY=value entries).
+// A block cut short, as when the head buffer ends inside embedded
+// artwork, yields the entries before the cut.
+static bool parseVorbisComment(const unsigned char *p, size_t size,
+                               TrackTags &tags) {
+  static const char *const KEYS[TAG_FIELD_COUNT] = {"TITLE", "ARTIST",
+                                                    "ALBUM", "GENRE"};
+  if (size < 8)
+    return false;
+  uint64_t pos = 4 + (uint64_t)readLE32(p);
+  if (pos + 4 > size)
+    return false;
+  uint32_t count = readLE32(p + pos);
+  pos += 4;
+  bool found = false;
+  for (uint32_t i = 0; i < count && pos + 4 <= size; ++i) {
+    uint32_t length = readLE32(p + pos);
+    pos += 4;
+    const char *entry = (const char *)p + pos;
+    size_t available = std::min<uint64_t>(length, size - pos);
+    pos += length;
+    const char *equals = (const char *)memchr(entry, '=', available);
+    if (!equals)
+      continue;
+    size_t keyLength = equals - entry;
+    for (int f = 0; f < TAG_FIELD_COUNT; ++f) {
+      if (keyLength == strlen(KEYS[f]) &&
+          strncasecmp(entry, KEYS[f], keyLength) == 0 &&
+          tags.field[f].empty() && pos <= size) {
+        tags.field[f].assign(equals + 1, entry + available);
+        trim(tags.field[f]);
+        found = found || !tags.field[f].empty();
+      }
+    }
+  }
+  return found;
+}
+
+static bool readFlac(const TagSource &source, uint64_t pos, TrackTags &tags) {
+  pos += 4; // "fLaC"
+  std::vector<unsigned char> block;
+  for (;;) {
+    unsigned char header[4];
+    if (!source.read(pos, header, 4))
+      return false;
+    bool last = (header[0] & 0x80) != 0;
+    uint32_t length = readBE24(header + 1);
+    pos += 4;
+    if ((header[0] & 0x7F) == 4) {
+      block.resize(std::min<size_t>(length, MAX_COMMENT_BYTES));
+      if (!source.read(pos, block.data(), block.size()))
+        return false;
+      return parseVorbisComment(block.data(), block.size(), tags);
+    }
+    if (last)
+      return false;
+    pos += length;
+  }
+}
+
+// Reassembles the second packet of the first logical stream, which holds
+// the comments for Vorbis, Opus and Ogg FLAC, from whatever pages the head
+// buffer holds.
+static bool readOgg(const TagSource &source, TrackTags &tags) {
+  const unsigned char *head = source.head;
+  size_t headSize = source.headSize;
+  std::string packet;
+  int packets = 0;
+  size_t pos = 0;
+  uint32_t serial = 0;
+  while (pos + 27 <= headSize && memcmp(&head[pos], "OggS", 4) == 0) {
+    uint32_t pageSerial = readLE32(&head[pos + 14]);
+    if (pos == 0)
+      serial = pageSerial;
+    size_t segments = head[pos + 26];
+    size_t data = pos + 27 + segments;
+    if (data > headSize)
+      break;
+    size_t pageSize = 0;
+    for (size_t s = 0; s < segments; ++s)
+      pageSize += head[pos + 27 + s];
+    if (pageSerial != serial) {
+      pos = data + pageSize;
+      continue;
+    }
+    for (size_t s = 0; s < segments && packets < 2; ++s) {
+      size_t lacing = head[pos + 27 + s];
+      size_t available = data < headSize
+                             ? std::min(lacing, headSize - data)
+                             : 0;
+      if (packets == 1)
+        packet.append((const char *)&head[data], available);
+      data += lacing;
+      if (lacing < 255)
+        ++packets;
+    }
+    if (packets >= 2 || data > headSize)
+      break;
+    pos = data;
+  }
+  if (packets < 1 || packet.empty())
+    return false;
+
+  const unsigned char *p = (const unsigned char *)packet.data();
+  size_t size = packet.size();
+  if (size >= 7 && memcmp(p, "\x03vorbis", 7) == 0)
+    return parseVorbisComment(p + 7, size - 7, tags);
+  if (size >= 8 && memcmp(p, "OpusTags", 8) == 0)
+    return parseVorbisComment(p + 8, size - 8, tags);
+  if (size >= 4 && (p[0] & 0x7F) == 4)
+    return parseVorbisComment(p + 4, size - 4, tags); // Ogg FLAC
+  return false;
+}
+
+bool parseTags(const char *path, uint64_t fileSize,
+               const unsigned char *head, size_t headSize,
+               const unsigned char *tail, size_t tailSize, TrackTags &tags) {
+  tags = TrackTags();
+  TagSource source = {path, fileSize, head, headSize, tail, tailSize};
+  if (headSize >= 4 && memcmp(head, "OggS", 4) == 0)
+    return readOgg(source, tags);
+
+  // FLAC files occasionally carry an ID3v2 tag in front of "fLaC".
+  bool found = false;
+  size_t tagSize = id3v2TagSize(head, headSize);
+  unsigned char magic[4];
+  if (source.read(tagSize, magic, 4) && memcmp(magic, "fLaC", 4) == 0)
+    found = readFlac(source, tagSize, tags);
+  if (!found && tagSize > 0)
+    found = readId3v2(source, tags);
+  if (!found)
+    found = readId3v1(source, tags);
+  return found;
+}
+
+bool readTags(const std::string &path, TrackTags &tags) {
+  tags = TrackTags();
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return false;
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return false;
+  }
+  std::vector<unsigned char> head(std::min<uint64_t>(TAG_HEAD_BYTES, st.st_size));
+  ssize_t got = pread(fd, head.data(), head.size(), 0);
+  close(fd);
+  return got > 0 && parseTags(path.c_str(), st.st_size, head.data(), got,
+                              nullptr, 0, tags);
+}
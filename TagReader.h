@@ -0,0 +1,43 @@
+#ifndef TAG_READER_H
+#define TAG_READER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+enum TagField {
+  TAG_TITLE,
+  TAG_ARTIST,
+  TAG_ALBUM,
+  TAG_GENRE,
+  TAG_FIELD_COUNT
+};
+
+// Field names as typed in queries ("artist:...") and stored in the index.
+extern const char *const TAG_FIELD_NAMES[TAG_FIELD_COUNT];
+
+// Text tags of a track as UTF-8; empty when the file has none.
+struct TrackTags {
+  std::string field[TAG_FIELD_COUNT];
+
+  bool empty() const;
+};
+
+// Bytes of a tag block read per file. Vorbis comments and ID3v2 frames
+// beyond this (usually after embedded artwork) are read with extra seeks
+// for ID3v2 and FLAC, and ignored for Ogg.
+const size_t TAG_HEAD_BYTES = 16384;
+
+// Parses tags from already-read bytes: head holds the start of the file,
+// tail its last tailSize bytes (for ID3v1). Parts of the file outside both
+// are read by opening path, only then, or skipped if path is NULL.
+bool parseTags(const char *path, uint64_t fileSize, const unsigned char *head,
+               size_t headSize, const unsigned char *tail, size_t tailSize,
+               TrackTags &tags);
+
+// Reads ID3v2 (falling back to ID3v1) from MP3 files and Vorbis comments
+// from FLAC and Ogg Vorbis/Opus/FLAC files. Returns false if the file
+// cannot be read or has no tags this reader understands.
+bool readTags(const std::string &path, TrackTags &tags);
+
+#endif // TAG_READER_H
@@ -10,10 +10,11 @@ struct termios orig_termios;
 
 void disableRawMode() {
   tcsetattr(STDIN_FILENO, TCSAFLUSH, &orig_termios);
-  std::cout << "\033[?25h"; // Show cursor
+  // Show cursor, stop focus reports
+  std::cout << "\033[?25h\033[?1004l" << std::flush;
 }
 
-void clearScreen() { std::cout << "\033[2J\033[H"; }
+void clearScreen() { std::cout << "\033[2J\033[H" << std::flush; }
 
 void enableRawMode() {
   tcgetattr(STDIN_FILENO, &orig_termios);
@@ -25,7 +26,8 @@ void enableRawMode() {
   raw.c_cc[VTIME] = 0;
 
   tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw);
-  std::cout << "\033[?25l"; // Hide cursor
+  // Hide cursor; ask for ESC [ I / ESC [ O when focus is gained or lost
+  std::cout << "\033[?25l\033[?1004h" << std::flush;
 }
 
 int kbhit() {
@@ -38,7 +40,12 @@ int kbhit() {
 
 void getTermSize(int &rows, int &cols) {
   struct winsize w;
-  ioctl(STDOUT_FILENO, TIOCGWINSZ, &w);
+  if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &w) != 0) {
+    // Not a terminal: assume the classic size.
+    rows = 24;
+    cols = 80;
+    return;
+  }
   rows = w.ws_row;
   cols = w.ws_col;
 }
@@ -0,0 +1,214 @@
+#include "TrackList.h"
+#include <algorithm>
+
+// The journal always has room for this many changes, however short the list.
+static const size_t JOURNAL_MIN = 1024;
+
+uint32_t TrackList::internTag(const std::string &value) {
+  if (value.empty())
+    return 0;
+  auto inserted = tagStringIds.emplace(value, (uint32_t)tagStrings.size());
+  if (inserted.second)
+    tagStrings.push_back(value);
+  return inserted.first->second;
+}
+
+void TrackList::grow(TrackId id) {
+  if (id >= metas.size()) {
+    metas.resize(id + 1);
+    listed.resize(id + 1, 0);
+    tagIds.resize((size_t)(id + 1) * TAG_FIELD_COUNT, 0);
+  }
+}
+
+// Records a change to id as part of the next version. Once the journal
+// overflows nothing more is recorded until that version is published.
+void TrackList::touch(TrackId id) {
+  if (journalFrom > version)
+    return;
+  if (journal.size() >= std::max(JOURNAL_MIN, order.size() / 8)) {
+    journal.clear();
+    journalFrom = version + 1;
+    return;
+  }
+  Change change = {version + 1, id};
+  journal.push_back(change);
+}
+
+bool TrackList::changedSince(uint64_t since,
+                             std::vector<TrackId> &changed) const {
+  if (since < journalFrom || since > version)
+    return false;
+  // Changes are recorded in version order, so the newer ones are a suffix.
+  for (size_t i = journal.size(); i > 0 && journal[i - 1].version > since;
+       --i)
+    changed.push_back(journal[i - 1].id);
+  return true;
+}
+
+TrackId TrackList::intern(const std::string &path) {
+  TrackId id = paths.intern(path);
+  grow(id);
+  return id;
+}
+
+// Stores meta for id, listing it (in added) if it is new. Returns true if
+// the track is new or its size or mtime changed.
+bool TrackList::update(TrackId id, const TrackMeta &meta,
+                       std::vector<TrackId> &added) {
+  grow(id);
+  touch(id);
+  TrackMeta &current = metas[id];
+  bool changed = true;
+  if (listed[id]) {
+    changed = current.size != meta.size || current.mtimeNs != meta.mtimeNs;
+    totalSeconds -= current.info.seconds();
+  } else {
+    listed[id] = 1;
+    added.push_back(id);
+  }
+  current = meta;
+  totalSeconds += current.info.seconds();
+  return changed;
+}
+
+void TrackList::insert(std::vector<TrackId> &added) {
+  auto less = [this](TrackId a, TrackId b) { return paths.less(a, b); };
+  std::sort(added.begin(), added.end(), less);
+  size_t middle = order.size();
+  order.insert(order.end(), added.begin(), added.end());
+  std::inplace_merge(order.begin(), order.begin() + middle, order.end(), less);
+}
+
+bool TrackList::merge(std::vector<ScannedTrack> &incoming) {
+  bool changed = false;
+  std::vector<TrackId> added;
+  for (auto &track : incoming) {
+    TrackId id = paths.intern(track.path);
+    changed |= update(id, track.meta, added);
+    for (int f = 0; f < TAG_FIELD_COUNT; ++f)
+      tagIds[(size_t)id * TAG_FIELD_COUNT + f] = internTag(track.tags.field[f]);
+  }
+  incoming.clear();
+
+  insert(added);
+  if (changed)
+    ++version;
+  return changed;
+}
+
+bool TrackList::merge(const Library &library) {
+  bool changed = false;
+  std::vector<TrackId> added;
+  added.reserve(library.size() + library.logSize());
+  // Reused for every record, so only new tag strings allocate
+  std::string scratch;
+  for (size_t i = 0; i < library.size() + library.logSize(); ++i) {
+    const LibraryRecord *pRecord;
+    if (i < library.size()) {
+      uint32_t index = library.byPath()[i];
+      if (index >= library.size() || library.isStale(index))
+        continue;
+      pRecord = &library.record(index);
+    } else {
+      pRecord = &library.logRecord(i - library.size());
+    }
+    const LibraryRecord &record = *pRecord;
+    scratch.assign(library.string(record.path));
+    TrackId id = paths.intern(scratch);
+    changed |= update(id, library.toMeta(record), added);
+    for (int f = 0; f < TAG_FIELD_COUNT; ++f) {
+      uint32_t &tag = tagIds[(size_t)id * TAG_FIELD_COUNT + f];
+      if (record.tags[f] == LIBRARY_NO_STRING) {
+        tag = 0;
+      } else {
+        scratch.assign(library.string(record.tags[f]));
+        tag = internTag(scratch);
+      }
+    }
+  }
+
+  insert(added);
+  if (changed)
+    ++version;
+  return changed;
+}
+
+void TrackList::remove(const std::vector<char> &doomed) {
+  // remove_if leaves unspecified values behind, so unlist while scanning
+  auto first = std::remove_if(order.begin(), order.end(), [&](TrackId id) {
+    if (!doomed[id])
+      return false;
+    touch(id);
+    listed[id] = 0;
+    totalSeconds -= metas[id].info.seconds();
+    return true;
+  });
+  order.erase(first, order.end());
+  ++version;
+}
+
+void TrackList::markUnconfirmed() {
+  for (TrackId id : order)
+    metas[id].onDisk = false;
+}
+
+bool TrackList::pruneMissing() {
+  std::vector<char> doomed(metas.size(), 0);
+  bool any = false;
+  for (TrackId id : order) {
+    if (!metas[id].onDisk) {
+      doomed[id] = 1;
+      any = true;
+    }
+  }
+  if (any)
+    remove(doomed);
+  return any;
+}
+
+bool TrackList::apply(LibraryUpdate &update) {
+  bool changed = false;
+  if (!update.removed.empty() || !update.removedDirs.empty()) {
+    std::vector<char> doomed(metas.size(), 0);
+    for (const auto &path : update.removed) {
+      TrackId id = paths.find(path);
+      if (isListed(id)) {
+        doomed[id] = 1;
+        changed = true;
+      }
+    }
+    for (const auto &dir : update.removedDirs) {
+      uint32_t dirId = paths.findDirectory(dir);
+      if (dirId == NO_DIRECTORY)
+        continue;
+      for (TrackId id : order) {
+        if (paths.isUnder(id, dirId)) {
+          doomed[id] = 1;
+          changed = true;
+        }
+      }
+    }
+    if (changed)
+      remove(doomed);
+  }
+  if (!update.changed.empty())
+    changed |= merge(update.changed);
+  return changed;
+}
+
+size_t TrackList::position(TrackId id) const {
+  if (id == NO_TRACK || id >= metas.size())
+    return 0;
+  size_t index = std::lower_bound(order.begin(), order.end(), id,
+                                  [this](TrackId a, TrackId b) {
+                                    return paths.less(a, b);
+                                  }) -
+                 order.begin();
+  return std::min(index, order.empty() ? 0 : order.size() - 1);
+}
+
+bool TrackList::save(const std::string &indexPath, std::string &error) const {
+  return Library::save(indexPath, paths, order, metas, tagIds, tagStrings,
+                       error);
+}
@@ -0,0 +1,88 @@
+#ifndef TRACK_LIST_H
+#define TRACK_LIST_H
+
+#include "Library.h"
+#include "LibraryWatcher.h"
+#include "PathTable.h"
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// The playlist: interned paths, per-track metadata indexed by TrackId and
+// the listed ids in path order. Ids stay valid when tracks are removed, so
+// a removed track that reappears gets its old id back. Tag values are
+// interned too, since a library repeats each artist, album and genre many
+// times.
+class TrackList {
+public:
+  // Adds or updates tracks; those already listed are updated in place.
+  // These return true if anything differs from what the index recorded.
+  bool merge(std::vector<ScannedTrack> &incoming);
+  // Lists every track of an index straight from its mapped records, and
+  // those its log added.
+  bool merge(const Library &library);
+  // Drops listed tracks not confirmed by a scan since markUnconfirmed().
+  bool pruneMissing();
+  void markUnconfirmed();
+  // Applies a watcher batch: removals first, then added or modified tracks.
+  bool apply(LibraryUpdate &update);
+  bool save(const std::string &indexPath, std::string &error) const;
+
+  // Id of path, which need not be listed (playlist entries outside the
+  // library or not scanned yet); meta() and tag() are empty until it is.
+  TrackId intern(const std::string &path);
+
+  size_t size() const { return order.size(); }
+  bool empty() const { return order.empty(); }
+  TrackId at(size_t index) const { return order[index]; }
+  const std::vector<TrackId> &getOrder() const { return order; }
+  // Index of id in the list, or of the track that now sits where it would
+  // be if it was removed.
+  size_t position(TrackId id) const;
+  bool isListed(TrackId id) const { return id < listed.size() && listed[id]; }
+
+  std::string path(TrackId id) const { return paths.path(id); }
+  const TrackMeta &meta(TrackId id) const { return metas[id]; }
+  const std::string &tag(TrackId id, TagField field) const {
+    return tagStrings[tagIds[(size_t)id * TAG_FIELD_COUNT + field]];
+  }
+  const PathTable &getPaths() const { return paths; }
+  double getTotalSeconds() const { return totalSeconds; }
+  // Bumped whenever tracks are added, removed or updated, so derived views
+  // (search corpus, tag index) know when to rebuild.
+  uint64_t getVersion() const { return version; }
+  // Appends the ids added, removed or updated since version was current,
+  // possibly with a few extra. False if that reaches back further than
+  // the journal, which is kept short; the caller then rebuilds instead.
+  bool changedSince(uint64_t since, std::vector<TrackId> &changed) const;
+
+private:
+  struct Change {
+    uint64_t version; // The version the change is part of
+    TrackId id;
+  };
+
+  void touch(TrackId id);
+  void remove(const std::vector<char> &doomed);
+  void grow(TrackId id);
+  bool update(TrackId id, const TrackMeta &meta, std::vector<TrackId> &added);
+  void insert(std::vector<TrackId> &added);
+  uint32_t internTag(const std::string &value);
+
+  PathTable paths;
+  std::vector<TrackMeta> metas; // Indexed by TrackId
+  std::vector<char> listed;     // Indexed by TrackId
+  std::vector<TrackId> order;   // Listed ids, sorted by PathTable::less
+  // TAG_FIELD_COUNT indices into tagStrings per TrackId; 0 is "".
+  std::vector<uint32_t> tagIds;
+  std::vector<std::string> tagStrings{std::string()};
+  std::unordered_map<std::string, uint32_t> tagStringIds;
+  double totalSeconds = 0.0;
+  uint64_t version = 0;
+  // Changes made after version journalFrom; dropped when it outgrows a
+  // fraction of the list, since a bulk change is cheaper to rebuild from.
+  std::vector<Change> journal;
+  uint64_t journalFrom = 0;
+};
+
+#endif // TRACK_LIST_H
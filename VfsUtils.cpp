@@ -0,0 +1,21 @@
+#include "VfsUtils.h"
+
+#include <cerrno>
+
+ma_result vfsResultFromErrno(int err) {
+  switch (err) {
+  case ENOENT:
+    return MA_DOES_NOT_EXIST;
+  case EACCES:
+  case EPERM:
+    return MA_ACCESS_DENIED;
+  case ENOMEM:
+    return MA_OUT_OF_MEMORY;
+  case EISDIR:
+    return MA_IS_DIRECTORY;
+  case EIO:
+    return MA_IO_ERROR;
+  default:
+    return MA_ERROR;
+  }
+}
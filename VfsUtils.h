@@ -0,0 +1,11 @@
+#ifndef VFS_UTILS_H
+#define VFS_UTILS_H
+
+#include "miniaudio.h"
+
+// Maps an errno from open/read/stat to the ma_result a VFS callback
+// returns. ma_result_from_errno() is private to the miniaudio
+// implementation.
+ma_result vfsResultFromErrno(int err);
+
+#endif // VFS_UTILS_H
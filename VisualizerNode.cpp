@@ -3,6 +3,28 @@
 #include <cmath>
 #include <cstring> // for memcpy
 
+void mapSpectrumToBars(const Complex *data, float *bars) {
+  // Map to bars (Linear mapping for simplicity first, or simple grouping)
+  // FFT_SIZE/2 bins (0 to Nyquist).
+  // We have 256 useful bins. We want 32 bars.
+  // 256 / 32 = 8 bins per bar.
+
+  int binsPerBar = (FFT_SIZE / 2) / NUM_BARS;
+
+  for (int b = 0; b < NUM_BARS; ++b) {
+    float magnitude = 0.0f;
+    for (int k = 0; k < binsPerBar; ++k) {
+      int binIdx = b * binsPerBar + k;
+      if (binIdx < FFT_SIZE / 2) {
+        magnitude += std::abs(data[binIdx]);
+      }
+    }
+    magnitude /= binsPerBar;
+
+    bars[b] = magnitude * 2.0f; // Gain
+  }
+}
+
 static void node_process_pcm_frames(ma_node *pNode, const float **ppFramesIn,
                                     ma_uint32 *pFrameCountIn,
                                     float **ppFramesOut,
@@ -32,36 +54,22 @@ static void node_process_pcm_frames(ma_node *pNode, const float **ppFramesIn,
     pVis->inputBuffer[pVis->writeIndex++] = sample;
 
     if (pVis->writeIndex >= FFT_SIZE) {
-      // Process FFT
-      CArray data(FFT_SIZE);
+      // Process FFT in the node's own buffer; the audio thread must not
+      // allocate
+      Complex *data = pVis->fftBuffer;
       for (int j = 0; j < FFT_SIZE; ++j) {
         // Hanning Window
         float window = 0.5f * (1.0f - cos(2.0f * PI * j / (FFT_SIZE - 1)));
         data[j] = Complex(pVis->inputBuffer[j] * window, 0);
       }
 
-      fft(data);
-
-      // Map to bars (Linear mapping for simplicity first, or simple grouping)
-      // FFT_SIZE/2 bins (0 to Nyquist).
-      // We have 256 useful bins. We want 32 bars.
-      // 256 / 32 = 8 bins per bar.
+      fft(data, FFT_SIZE);
 
-      int binsPerBar = (FFT_SIZE / 2) / NUM_BARS;
-
-      for (int b = 0; b < NUM_BARS; ++b) {
-        float magnitude = 0.0f;
-        for (int k = 0; k < binsPerBar; ++k) {
-          int binIdx = b * binsPerBar + k;
-          if (binIdx < FFT_SIZE / 2) {
-            magnitude += std::abs(data[binIdx]);
-          }
-        }
-        magnitude /= binsPerBar;
-
-        float val = magnitude * 2.0f; // Gain
-        pVis->bars[b].store(val, std::memory_order_relaxed);
-      }
+      float bars[NUM_BARS];
+      mapSpectrumToBars(data, bars);
+      for (int b = 0; b < NUM_BARS; ++b)
+        pVis->bars[b].store(bars[b], std::memory_order_relaxed);
+      pVis->sequence.fetch_add(1, std::memory_order_release);
 
       pVis->writeIndex = 0;
     }
@@ -1,8 +1,10 @@
 #ifndef VISUALIZER_NODE_H
 #define VISUALIZER_NODE_H
 
+#include "FftUtils.h"
 #include "miniaudio.h"
 #include <atomic>
+#include <cstdint>
 
 const int FFT_SIZE = 512;
 const int NUM_BARS = 32;
@@ -10,12 +12,19 @@ const int NUM_BARS = 32;
 struct VisualizerNode {
   ma_node_base base;
   std::atomic<float> bars[NUM_BARS];
+  // Bumped after each new set of bars, so readers can tell a fresh
+  // spectrum from one they have already drawn.
+  std::atomic<uint32_t> sequence{0};
 
   // Audio Thread Local Storage
   float inputBuffer[FFT_SIZE];
+  Complex fftBuffer[FFT_SIZE];
   int writeIndex = 0;
 };
 
+// Groups the first FFT_SIZE / 2 bins of a spectrum into NUM_BARS bars
+void mapSpectrumToBars(const Complex *data, float *bars);
+
 // VTable for the visualizer node
 extern ma_node_vtable g_visualizer_vtable;
 
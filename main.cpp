@@ -1,5 +1,17 @@
+#include "EventLoop.h"
+#include "FrameScheduler.h"
+#include "FuzzySearch.h"
+#include "Library.h"
+#include "LibraryScanner.h"
+#include "LibraryWatcher.h"
 #include "MusicPlayer.h"
+#include "OfflineRender.h"
+#include "PlayerController.h"
+#include "Playlist.h"
+#include "Screen.h"
+#include "Shuffle.h"
 #include "TUI.h"
+#include "TrackList.h"
 #include "TerminalUtils.h"
 #include "VisualizerNode.h" // For NUM_BARS constant if needed, or rely on TUI
 
@@ -7,19 +19,8 @@
 #include <cstdlib>
 #include <filesystem>
 #include <iostream>
-#include <sstream>
-#include <thread>
 #include <thread>
 #include <unistd.h>
-#include <csignal>
-#include <atomic>
-
-std::atomic<bool> resizeRequest(false);
-
-void handleResize(int sig) {
-    resizeRequest = true;
-}
-
 
 namespace fs = std::filesystem;
 
@@ -50,74 +51,418 @@ enum AppMode {
 };
 
 
-std::vector<std::string> getAudioFiles(const std::string &path) {
-  std::vector<std::string> files;
-  for (const auto &entry : fs::directory_iterator(path)) {
-    if (entry.is_regular_file()) {
-      std::string ext = entry.path().extension().string();
-      if (ext == ".mp3" || ext == ".wav" || ext == ".flac" || ext == ".ogg") {
-        files.push_back(entry.path().filename().string());
+// Index of the scanned directory, kept next to the music it describes.
+const char *LIBRARY_INDEX_PATH = ".musical-c.index";
+// Where 'w' saves the playlist being played.
+const char *SAVED_PLAYLIST_PATH = "musical-c.m3u8";
+
+void printUsage(const char *prog) {
+  std::cout << "Usage: " << prog << " [options]\n"
+            << "  --period-frames N  Device period size in frames\n"
+            << "  --periods N        Number of device periods\n"
+            << "  --low-latency      Use the low latency performance profile\n"
+            << "  --exclusive        Request exclusive device access\n"
+            << "  --io MODE          File reads: mmap (default), stdio or "
+               "readahead\n"
+            << "  --readahead-depth N  Blocks prefetched in readahead mode\n"
+            << "  --render IN OUT    Render IN to a WAV file OUT without a "
+               "device\n"
+            << "  --scan-io-depth N  Concurrent file reads while scanning "
+               "(default: 2 on network mounts, 8 otherwise)\n"
+            << "  --playlist FILE    Play an M3U, M3U8 or PLS playlist\n"
+            << "  --fps N            Frame rate while playing (default: 30)\n"
+            << "  -h, --help         Show this help\n";
+}
+
+// Returns false if the program should exit (help or bad arguments).
+// --render only records its paths; main runs it once every option, before
+// or after it, has been applied to config.
+bool parseArgs(int argc, char **argv, AudioConfig &config,
+               unsigned &scanIoDepth, std::string &playlistPath, int &fps,
+               std::string &renderIn, std::string &renderOut, int &exitCode) {
+  exitCode = 0;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if ((arg == "--period-frames" || arg == "--periods" ||
+         arg == "--readahead-depth" || arg == "--scan-io-depth" ||
+         arg == "--fps") &&
+        i + 1 < argc) {
+      int value = std::atoi(argv[++i]);
+      if (value <= 0) {
+        std::cerr << arg << " expects a positive number." << std::endl;
+        exitCode = 1;
+        return false;
+      }
+      if (arg == "--period-frames")
+        config.periodSizeInFrames = value;
+      else if (arg == "--periods")
+        config.periods = value;
+      else if (arg == "--scan-io-depth")
+        scanIoDepth = value;
+      else if (arg == "--fps")
+        fps = value;
+      else
+        config.readAheadDepth = value;
+    } else if (arg == "--low-latency") {
+      config.lowLatency = true;
+    } else if (arg == "--exclusive") {
+      config.exclusive = true;
+    } else if (arg == "--io" && i + 1 < argc) {
+      std::string mode = argv[++i];
+      if (mode == "mmap") {
+        config.ioMode = IO_MMAP;
+      } else if (mode == "stdio") {
+        config.ioMode = IO_STDIO;
+      } else if (mode == "readahead") {
+        config.ioMode = IO_READAHEAD;
+      } else {
+        std::cerr << "Unknown --io mode: " << mode << std::endl;
+        exitCode = 1;
+        return false;
       }
+    } else if (arg == "--playlist" && i + 1 < argc) {
+      playlistPath = argv[++i];
+    } else if (arg == "--render" && i + 2 < argc) {
+      renderIn = argv[++i];
+      renderOut = argv[++i];
+    } else if (arg == "-h" || arg == "--help") {
+      printUsage(argv[0]);
+      return false;
+    } else {
+      std::cerr << "Unknown option: " << arg << std::endl;
+      printUsage(argv[0]);
+      exitCode = 1;
+      return false;
     }
   }
-  std::sort(files.begin(), files.end());
-  return files;
+  return true;
 }
 
-int main() {
-  TermMusicPlayer player;
+int main(int argc, char **argv) {
+  AudioConfig audioConfig;
+  unsigned scanIoDepth = 0;
+  std::string playlistPath;
+  int fps = DEFAULT_FPS;
+  std::string renderIn, renderOut;
+  int exitCode;
+  if (!parseArgs(argc, argv, audioConfig, scanIoDepth, playlistPath, fps,
+                 renderIn, renderOut, exitCode))
+    return exitCode;
+  if (!renderIn.empty())
+    return renderToFile(renderIn, renderOut, audioConfig);
+
+  // The UI thread sleeps here between events. It blocks SIGWINCH, SIGTERM
+  // and SIGINT for the signalfd, so it has to exist before any thread
+  // starts.
+  EventLoop events;
+
+  TermMusicPlayer player(audioConfig);
   if (!player.isInit()) {
     std::cerr << "Failed to initialize audio engine." << std::endl;
     return 1;
   }
 
-  std::vector<std::string> files = getAudioFiles(".");
-  int currentIndex = 0;
+  // All playback control goes through the controller's command queue; the
+  // loop below only reads its published state.
+  PlayerController controller(player);
+  controller.setNotifyFd(events.getWakeFd());
+
+  // The playlist starts from the index of the last run, if any, while a
+  // background scan validates it and streams in new tracks. Without an
+  // index only the first track is waited for.
+  Library library;
+  TrackList tracks;
+  std::vector<ScannedTrack> incoming;
+  bool libraryChanged = !library.open(LIBRARY_INDEX_PATH);
+  tracks.merge(library);
+
+  // A playlist replaces the library as the play order. Its entries are
+  // interned with the library's paths, so tracks the scan finds later pick
+  // up their lengths and tags.
+  Playlist playlist;
+  if (!playlistPath.empty() && !playlist.load(playlistPath, tracks))
+    return 1;
+
+  // Registered with every directory the scanner visits, so changes made
+  // while the player runs are picked up without rescanning.
+  LibraryWatcher watcher;
+  watcher.setNotifyFd(events.getWakeFd());
+  std::unique_ptr<LibraryScanner> scanner(
+      new LibraryScanner(".", &library, &watcher, 0, scanIoDepth));
+  bool scanning = true;
+
+  while (tracks.empty() && playlist.empty()) {
+    bool finished = scanner->isDone();
+    if (scanner->poll(incoming))
+      libraryChanged |= tracks.merge(incoming);
+    if (finished)
+      break;
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
 
-  if (files.empty()) {
+  if (tracks.empty() && playlist.empty()) {
     std::cout << "No audio files found in current directory." << std::endl;
     return 0;
   }
+  // Selection is kept by id, so it survives the list growing and shrinking.
+  // A playlist may repeat a track, so its position is kept as an index.
+  TrackId currentTrack = playlist.empty() ? tracks.at(0) : playlist.at(0);
+  size_t playlistPos = 0;
 
   enableRawMode();
   clearScreen();
-  // Register Signal Handler
-  signal(SIGWINCH, handleResize);
 
   bool running = true;
   bool dirty = true;
   AppMode currentMode = MODE_LOCAL;
   std::string ytTitle = "No Audio Loaded";
+  // Refreshed from the controller only when the snapshot's title id changes
+  std::string title = "None";
+  ma_uint32 titleId = 0;
+  // '/' search: keys edit the query until Enter plays the selection or Esc
+  // cancels.
+  FuzzySearch search;
+  bool searching = false;
+  std::string query;
+  size_t searchSelection = 0;
+  // 's' toggles shuffled order for n/p.
+  Shuffle shuffle;
+  bool shuffling = false;
+  // Result of the last 'w' or a failed index write, shown until the next
+  // key. Nothing else may print while the UI owns the terminal.
+  std::string notice;
+  // Frames are diffed against what the terminal shows; anything else that
+  // writes to the terminal must invalidate it.
+  Screen screen;
+  // Reused every frame: the UI text, what is sent to the terminal, and
+  // scratch for labels and visualizer bars.
+  FrameBuffer text;
+  FrameBuffer frame;
+  std::string label;
+  std::vector<float> bars;
+  // Ticks at the target frame rate while playing, drawing only frames that
+  // look different. The terminal reports focus changes; while it is
+  // unfocused the ticks slow down. Nothing ticks while the terminal is too
+  // small for the UI.
+  FrameScheduler scheduler(fps);
+  bool focused = true;
+  bool visible = true;
 
 
   while (running) {
+    // Sleep until a key, a signal, a frame tick or a wakeup from the
+    // controller or the watcher. Ticks only run while something on screen
+    // moves by itself; the first pass draws straight away.
+    events.setTick(scheduler.tickMs(controller.snapshot().playing(),
+                                    scanning, visible, focused));
+    unsigned fired = events.wait(dirty ? 0 : -1);
+    if (fired & EVENT_QUIT)
+      running = false;
+    if (fired & (EVENT_RESIZE | EVENT_WAKE))
+      dirty = true;
+    bool ticked = (fired & EVENT_TICK) != 0;
+
+    if (scanning) {
+      // Checked before polling so tracks found in between are not lost.
+      bool finished = scanner->isDone();
+      if (scanner->poll(incoming)) {
+        libraryChanged |= tracks.merge(incoming);
+        dirty = true;
+      }
+      if (finished) {
+        libraryChanged |= tracks.pruneMissing();
+        std::string error;
+        if (libraryChanged && !tracks.save(LIBRARY_INDEX_PATH, error))
+          notice = error;
+        libraryChanged = false;
+        scanning = false;
+        dirty = true;
+      }
+    }
+
+    LibraryUpdate update;
+    if (watcher.poll(update)) {
+      if (update.rescan) {
+        // Events were dropped: rescan everything and let the final prune
+        // remove what is gone.
+        tracks.markUnconfirmed();
+        scanner.reset();
+        scanner.reset(
+            new LibraryScanner(".", &library, &watcher, 0, scanIoDepth));
+        scanning = true;
+      }
+      // One index write per batch; during a scan it is written at the end.
+      // A batch is appended to the index's log, logged before apply()
+      // consumes it; the whole index is only rewritten once the log has
+      // grown as large as it.
+      std::string error;
+      bool logged = !scanning &&
+                    Library::appendLog(LIBRARY_INDEX_PATH, update.changed,
+                                       update.removed, update.removedDirs,
+                                       error);
+      libraryChanged |= tracks.apply(update);
+      if (libraryChanged && !scanning) {
+        if (!logged && !tracks.save(LIBRARY_INDEX_PATH, error))
+          notice = error;
+        libraryChanged = false;
+      }
+      dirty = true;
+    }
+
     // Handle Input
-    if (kbhit()) {
+    if (fired & EVENT_INPUT) {
       char c;
-      if (read(STDIN_FILENO, &c, 1) == 1) {
+      ssize_t got = read(STDIN_FILENO, &c, 1);
+      if (got == 0)
+        events.closeInput(); // End of file; keep playing without keys
+      // Arrow keys arrive as ESC [ A/B and focus reports as ESC [ I/O.
+      char escape = 0;
+      if (got == 1 && c == 27) {
+        char seq[2];
+        if (kbhit() && read(STDIN_FILENO, &seq[0], 1) == 1 &&
+            seq[0] == '[' && read(STDIN_FILENO, &seq[1], 1) == 1)
+          escape = seq[1];
+      }
+      if (escape == 'I' || escape == 'O') {
+        focused = escape == 'I';
+        if (focused)
+          dirty = true;
+      } else if (got == 1) {
         dirty = true;
-        if (c == 'q') {
+        notice.clear();
+        if (searching) {
+          bool edited = false;
+          if (c == 27) {
+            // A lone ESC cancels.
+            if (escape == 'A' && searchSelection > 0)
+              --searchSelection;
+            else if (escape == 'B' &&
+                     searchSelection + 1 < search.getResults().size())
+              ++searchSelection;
+            else if (escape == 0)
+              searching = false;
+          } else if (c == '\r' || c == '\n') {
+            if (searchSelection < search.getResults().size()) {
+              currentTrack = search.getResults()[searchSelection].id;
+              controller.play(tracks.path(currentTrack));
+              // The search covers the library; n/p continue from the
+              // result's entry if the playlist has one.
+              size_t entry = playlist.find(currentTrack, playlistPos);
+              if (entry < playlist.size())
+                playlistPos = entry;
+              if (shuffling) {
+                // A playlist keeps its position, as it does without shuffle
+                size_t position = playlist.empty()
+                                      ? tracks.position(currentTrack)
+                                      : playlistPos;
+                shuffle.record({currentTrack, position});
+              }
+            }
+            searching = false;
+          } else if (c == 127 || c == 8) {
+            if (!query.empty()) {
+              query.pop_back();
+              edited = true;
+            }
+          } else if (c == 16) { // Ctrl-P
+            if (searchSelection > 0)
+              --searchSelection;
+          } else if (c == 14) { // Ctrl-N
+            if (searchSelection + 1 < search.getResults().size())
+              ++searchSelection;
+          } else if (c >= 32 && c < 127) {
+            query += c;
+            edited = true;
+          }
+          if (edited) {
+            search.search(query);
+            searchSelection = 0;
+          }
+        } else if (c == '/' && currentMode == MODE_LOCAL && !tracks.empty()) {
+          searching = true;
+          query.clear();
+          searchSelection = 0;
+          // Tracks found while the box is open show up the next time.
+          search.sync(tracks);
+          search.reset();
+          search.search(query);
+        } else if (c == 'q') {
           running = false;
         } else if (c == ' ') {
-          player.togglePause();
-        } else if (c == 'n' && currentMode == MODE_LOCAL) {
-          currentIndex = (currentIndex + 1) % files.size();
-          player.play(files[currentIndex]);
-        } else if (c == 'p' && currentMode == MODE_LOCAL) {
-          currentIndex = (currentIndex - 1 + files.size()) % files.size();
-          player.play(files[currentIndex]);
+          controller.togglePause();
+        } else if (c == 's' && currentMode == MODE_LOCAL) {
+          shuffling = !shuffling;
+          if (shuffling) {
+            size_t position = playlist.empty() ? tracks.position(currentTrack)
+                                               : playlistPos;
+            shuffle.reset({currentTrack, position});
+          }
+        } else if (c == 'w' && currentMode == MODE_LOCAL) {
+          Playlist saved;
+          if (playlist.empty())
+            saved.assign(tracks.getOrder());
+          else
+            saved = playlist;
+          std::string error;
+          notice = saved.save(SAVED_PLAYLIST_PATH, tracks, error)
+                       ? std::string("Saved ") + SAVED_PLAYLIST_PATH
+                       : error;
+        } else if (c == 'n' && currentMode == MODE_LOCAL && !playlist.empty()) {
+          if (shuffling) {
+            ShufflePick pick = shuffle.next(playlist.getEntries());
+            currentTrack = pick.id;
+            playlistPos = pick.position;
+          } else {
+            playlistPos = (playlistPos + 1) % playlist.size();
+            currentTrack = playlist.at(playlistPos);
+          }
+          controller.play(tracks.path(currentTrack));
+        } else if (c == 'p' && currentMode == MODE_LOCAL && !playlist.empty()) {
+          if (shuffling) {
+            ShufflePick previous = shuffle.previous();
+            if (previous.id != NO_TRACK) {
+              currentTrack = previous.id;
+              playlistPos = previous.position;
+              controller.play(tracks.path(currentTrack));
+            }
+          } else {
+            playlistPos = (playlistPos + playlist.size() - 1) % playlist.size();
+            currentTrack = playlist.at(playlistPos);
+            controller.play(tracks.path(currentTrack));
+          }
+        } else if (c == 'n' && currentMode == MODE_LOCAL && !tracks.empty()) {
+          if (shuffling) {
+            currentTrack = shuffle.next(tracks.getOrder()).id;
+          } else {
+            size_t index = (tracks.position(currentTrack) + 1) % tracks.size();
+            currentTrack = tracks.at(index);
+          }
+          controller.play(tracks.path(currentTrack));
+        } else if (c == 'p' && currentMode == MODE_LOCAL && !tracks.empty()) {
+          if (shuffling) {
+            // Back through the shuffle history; stays put at its start.
+            ShufflePick previous = shuffle.previous();
+            if (previous.id != NO_TRACK) {
+              currentTrack = previous.id;
+              controller.play(tracks.path(currentTrack));
+            }
+          } else {
+            size_t index = tracks.position(currentTrack);
+            currentTrack = tracks.at((index + tracks.size() - 1) % tracks.size());
+            controller.play(tracks.path(currentTrack));
+          }
         } else if (c == '=' || c == '+') {
-          player.changeVolume(0.05f);
+          controller.changeVolume(0.05f);
         } else if (c == '-' || c == '_') {
-          player.changeVolume(-0.05f);
+          controller.changeVolume(-0.05f);
         } else if (c == 'f') {
-          player.seekBy(5.0f);
+          controller.seekBy(5.0f);
         } else if (c == 'b') {
-          player.seekBy(-5.0f);
+          controller.seekBy(-5.0f);
         } else if (c == 'y') {
           if (currentMode == MODE_LOCAL) {
               // Switch TO YouTube Mode
-              player.stop();
+              controller.stop();
               currentMode = MODE_YOUTUBE;
               disableRawMode();
               
@@ -147,7 +492,7 @@ int main() {
                   int ret = system(cmd.c_str());
                   
                   if (ret == 0 && fs::exists("playing.mp3")) {
-                      player.play("playing.mp3");
+                      controller.play("playing.mp3");
                   } else {
                       // If it failed, it might be due to network or severe error. 
                       // Since we silence output, we can't see why, but we keep UI clean.
@@ -162,19 +507,21 @@ int main() {
               }
               enableRawMode();
               clearScreen();
+              screen.invalidate();
               dirty = true;
           } else {
               // Switch FROM YouTube Mode (Back to Local)
-              player.stop();
+              controller.stop();
               currentMode = MODE_LOCAL;
               // Clear screen completely to prevent ghosts
               std::cout << "\033[2J\033[H";
               std::cout.flush();
+              screen.invalidate();
               dirty = true;
           }
         } else if (c == 'u' && currentMode == MODE_YOUTUBE) {
              // Optional: Allow entering new URL without exiting mode?
-             player.stop();
+             controller.stop();
              disableRawMode();
              std::cout << "\033[2J\033[H";
              std::cout << "=== YouTube Mode ===\r\n";
@@ -191,7 +538,7 @@ int main() {
                   std::string cmd = "./yt-dlp --no-warnings --ffmpeg-location ./bin/ffmpeg -x --audio-format mp3 -o \"playing.mp3\" \"" + url + "\" > /dev/null 2>&1";
                   int ret = system(cmd.c_str());
                   if (ret == 0 && fs::exists("playing.mp3")) {
-                      player.play("playing.mp3");
+                      controller.play("playing.mp3");
                   } else {
                       std::cout << "Download failed.\r\n";
                       ytTitle = "Error Loading Video";
@@ -200,30 +547,24 @@ int main() {
              }
              enableRawMode();
              clearScreen();
+             screen.invalidate();
              dirty = true;
         }
       }
     }
 
-    // Update dirty check: if playing, we need to redraw progress bar every so
-    // often
-    // Update dirty check: if playing, we need to redraw progress bar every so
-    // often
-    if (player.isPlaying())
-      dirty = true;
-    
-    // Handle Window Resize
-    if (resizeRequest) {
-        resizeRequest = false;
-        dirty = true;
-    }
+    PlaybackSnapshot snap = controller.snapshot();
 
     // Render UI
-    if (dirty) {
+    if (dirty || ticked) {
       int rows, cols;
       getTermSize(rows, cols);
 
-      if (rows < 25 || cols < 40) {
+      // Stops the ticks until a resize brings the UI back
+      visible = rows >= 25 && cols >= 40;
+      if (!visible) {
+          if (!dirty)
+            continue; // The warning is already up
           // Terminal too small - show warning instead of broken UI
           std::cout << "\033[H\033[2J"; // Home and Clear
           std::cout << "Terminal too small.\r\n";
@@ -231,9 +572,8 @@ int main() {
           std::cout << "Current: " << rows << "x" << cols << "\r\n";
           std::cout << "Press 'q' to quit.\r\n";
           std::cout.flush();
-          dirty = false; 
-          // Sleep to avoid busy loop if just resizing
-          std::this_thread::sleep_for(std::chrono::milliseconds(100));
+          screen.invalidate();
+          dirty = false;
           continue;
       }
 
@@ -245,6 +585,8 @@ int main() {
       // Now Playing: 1 line
       // Status: 1 line
       // Vol: 1 line
+      // Latency: 1 line
+      // Memory: 1 line
       // Prog: 1 line
       // Empty: 1 line
       // Playlist Header + Items + Spacer: 9-ish lines 
@@ -252,86 +594,203 @@ int main() {
       // Empty: 1 line (at end)
       
       // Total approx 20-22 lines of fixed content.
-      int reservedHeight = 24; 
+      int reservedHeight = 26;
       int visHeight = std::max(2, rows - reservedHeight);
 
       // Widths
       int totalWidth = std::max(40, cols - 4);      // Margin
       int barWidth = std::max(10, totalWidth - 25); // Room for timestamps
 
-      std::stringstream buffer;
-      // \033[2J = Clear entire screen
-      // \033[3J = Clear scrollback buffer (pushes everything up/gone)
-      // \033[H  = Move cursor to home
-      buffer << "\033[2J\033[3J\033[H";
+      // A tick alone only draws if something it animates changed.
+      float cursor = controller.smoothCursorSeconds(snap);
+      FrameInputs inputs;
+      inputs.spectrumSequence = player.getVisSequence();
+      if (dirty ||
+          inputs.spectrumSequence != scheduler.getLast().spectrumSequence) {
+        player.getVisData(bars);
+        for (int i = 0; i < NUM_BARS; ++i)
+          inputs.barRows[i] = barRows(bars[i], visHeight);
+      } else {
+        inputs.barRows = scheduler.getLast().barRows;
+      }
+      inputs.cursorSecond = (int)cursor;
+      inputs.progressCells =
+          progressCells(cursor, snap.lengthSeconds(), barWidth);
+      inputs.volumePercent = (int)(snap.volume * 100);
+      if (scanning) {
+        ScanProgress progress = scanner->getProgress();
+        inputs.scanCount = progress.directories + progress.files +
+                           progress.metadata.parsed;
+      }
+      if (!dirty && !scheduler.changed(inputs))
+        continue;
+      scheduler.drawn(inputs);
+
+      if (snap.titleId != titleId) {
+        title = *controller.title();
+        titleId = snap.titleId;
+      }
 
-      buffer << COLOR_BOLD << COLOR_MAGENTA
-             << "=== Terminal Music Player ===" << COLOR_RESET << "\r\n";
+      text.clear();
+      text.append(COLOR_BOLD COLOR_MAGENTA
+                  "=== Terminal Music Player ===" COLOR_RESET "\r\n");
 
       // Visualizer Area
-      std::vector<float> bars;
-      player.getVisData(bars);
-      drawVisualizer(buffer, bars, visHeight);
-
-      buffer << "-----------------------------" << "\r\n";
-      buffer << "Now Playing: " << COLOR_CYAN << (currentMode == MODE_LOCAL ? player.getCurrentTitle() : ytTitle)
-             << COLOR_RESET << "\r\n";
-      buffer << "Status: [" << (currentMode == MODE_LOCAL ? "LOCAL" : "YOUTUBE") << "] "
-             << (player.isPlaying()
-                     ? (std::string(COLOR_GREEN) + "[PLAYING]" + COLOR_RESET)
-                     : (std::string(COLOR_YELLOW) + "[PAUSED]" + COLOR_RESET))
-             << "\r\n";
-      buffer << "Volume: "
-             << drawVolumeBar(player.getVolume(), std::min(20, totalWidth / 2))
-             << "\r\n";
-      buffer << "Progress: "
-             << drawProgressBar(player.getCursor(), player.getLength(),
-                                barWidth)
-             << "\r\n";
-
-      buffer << "\r\n";
+      drawVisualizer(text, bars, visHeight);
+
+      text.append("-----------------------------\r\n");
+      text.append("Now Playing: " COLOR_CYAN);
+      text.append(currentMode == MODE_LOCAL ? title : ytTitle);
+      text.append(COLOR_RESET "\r\n");
+      text.append(currentMode == MODE_LOCAL ? "Status: [LOCAL] "
+                                            : "Status: [YOUTUBE] ");
+      text.append(snap.playing() ? COLOR_GREEN "[PLAYING]" COLOR_RESET
+                                 : COLOR_YELLOW "[PAUSED]" COLOR_RESET);
+      if (shuffling && currentMode == MODE_LOCAL)
+        text.append(" [SHUFFLE]");
+      if (!notice.empty()) {
+        text.append("  ");
+        text.append(notice);
+      }
+      text.append("\r\n");
+      text.append("Volume: ");
+      drawVolumeBar(text, snap.volume, std::min(20, totalWidth / 2));
+      text.append("\r\n");
+      text.appendf("Latency: %.1f ms (%u x %u @ %u Hz%s)",
+                   player.getLatencyMs(), player.getPeriodSizeInFrames(),
+                   player.getPeriods(), player.getSampleRate(),
+                   player.isExclusive() ? ", exclusive" : "");
+      if (player.getIoMode() == IO_READAHEAD) {
+        ReadAheadStats io = player.getReadAheadStats();
+        text.appendf(" | Read-ahead: %llu hit, %llu miss, %llu stall (max %.0f ms)",
+                     (unsigned long long)io.hits, (unsigned long long)io.misses,
+                     (unsigned long long)io.stalls, io.maxStallNs / 1e6);
+      }
+      text.append("\r\n");
+      AllocStats mem = player.getAllocStats();
+      text.appendf("Memory: track %.1f MB (%llu allocs), engine %.1f MB, "
+                   "peak %.1f MB\r\n",
+                   mem.category[ALLOC_TRACK].liveBytes / 1e6,
+                   (unsigned long long)mem.trackAllocs,
+                   mem.category[ALLOC_ENGINE].liveBytes / 1e6,
+                   (mem.category[ALLOC_TRACK].peakBytes +
+                    mem.category[ALLOC_ENGINE].peakBytes) /
+                       1e6);
+      text.append("Progress: ");
+      drawProgressBar(text, cursor, snap.lengthSeconds(), barWidth);
+      text.append("\r\n");
+
+      text.append("\r\n");
       
-      if (currentMode == MODE_LOCAL) {
+      if (currentMode == MODE_LOCAL && searching) {
+          const std::vector<SearchResult> &results = search.getResults();
+          text.append("Search: /");
+          text.append(query);
+          text.appendf(COLOR_BOLD "_" COLOR_RESET "  (%zu matches, %.1f ms)\r\n",
+                       search.getMatchCount(), search.getLastSearchMs());
+          bool byTag = TagIndex::isTagQuery(query);
+          int start = std::max(0, (int)searchSelection - 3);
+          int end = std::min((int)results.size(), start + 7);
+          for (int i = start; i < end; ++i) {
+            TrackId id = results[i].id;
+            text.append(i == (int)searchSelection
+                            ? COLOR_BOLD COLOR_GREEN " > "
+                            : "   ");
+            // Tag matches are shown by their tags, path matches by path.
+            if (byTag && !tracks.tag(id, TAG_TITLE).empty()) {
+              text.append(tracks.tag(id, TAG_ARTIST));
+              text.append(" - ");
+              text.append(tracks.tag(id, TAG_TITLE));
+            } else {
+              label.clear();
+              tracks.getPaths().appendPath(id, label);
+              text.append(label);
+            }
+            if (i == (int)searchSelection)
+              text.append(COLOR_RESET);
+            text.append("\r\n");
+          }
+      } else if (currentMode == MODE_LOCAL) {
           // Truncate playlist to show fewer items to save space
+          bool fromPlaylist = !playlist.empty();
+          int listSize = fromPlaylist ? playlist.size() : tracks.size();
+          int currentIndex =
+              fromPlaylist ? playlistPos : tracks.position(currentTrack);
           int start = std::max(0, currentIndex - 3);
-          int end = std::min((int)files.size(), start + 7);
+          int end = std::min(listSize, start + 7);
 
-          buffer << "Playlist:\r\n";
+          text.append("Playlist: ");
+          if (fromPlaylist) {
+            text.append(playlistPath);
+            text.appendf(", %d entries", listSize);
+          } else {
+            text.appendf("%zu tracks, ", tracks.size());
+            appendDuration(text, tracks.getTotalSeconds());
+          }
+          if (scanning) {
+            // Files needing their headers read go through the metadata
+            // pipeline; the rest came from the index.
+            ScanProgress progress = scanner->getProgress();
+            text.appendf(" (scanning: %zu dirs, %zu files, metadata %zu/%zu, "
+                         "%u/%u reads)",
+                         progress.directories, progress.files,
+                         progress.metadata.parsed, progress.metadata.submitted,
+                         progress.metadata.readsInFlight, progress.ioDepth);
+          }
+          text.append("\r\n");
           for (int i = start; i < end; ++i) {
-            if (i == currentIndex) {
-              buffer << COLOR_BOLD << COLOR_GREEN << " > " << files[i]
-                     << COLOR_RESET << "\r\n";
+            TrackId id = fromPlaylist ? playlist.at(i) : tracks.at(i);
+            const AudioProbeInfo &info = tracks.meta(id).info;
+            text.append(i == currentIndex ? COLOR_BOLD COLOR_GREEN " > "
+                                          : "   ");
+            label.clear();
+            tracks.getPaths().appendPath(id, label);
+            text.append(label);
+            text.append("  ");
+            if (info.ok) {
+              if (info.estimated)
+                text.append('~');
+              appendTime(text, info.seconds());
             } else {
-              buffer << "   " << files[i] << "\r\n";
+              text.append("--:--");
             }
+            if (i == currentIndex)
+              text.append(COLOR_RESET);
+            text.append("\r\n");
           }
       } else {
           // YouTube Mode UI
-          buffer << COLOR_BOLD << COLOR_RED << "   YOUTUBE PLAYER   " << COLOR_RESET << "\r\n";
-          buffer << "   Playing from dynamic stream.\r\n";
-          buffer << "   Title: " << ytTitle << "\r\n";
-          buffer << "   (Files hidden in this mode)\r\n";
-          buffer << "\r\n\r\n";
+          text.append(COLOR_BOLD COLOR_RED "   YOUTUBE PLAYER   " COLOR_RESET "\r\n");
+          text.append("   Playing from dynamic stream.\r\n");
+          text.append("   Title: ");
+          text.append(ytTitle);
+          text.append("\r\n");
+          text.append("   (Files hidden in this mode)\r\n");
+          text.append("\r\n\r\n");
       }
 
-      buffer << "\r\n";
-      buffer << "\r\n";
-      if (currentMode == MODE_LOCAL) {
-        buffer << "Controls: [Space] Pause | [n] Next | [p] Prev | [+/-] Vol | [f/b] Seek | [y] YouTube | [q] Quit\r\n";
+      text.append("\r\n");
+      text.append("\r\n");
+      if (searching) {
+        text.append("Search: type to filter | [Up/Down] Select | [Enter] Play | [Esc] Cancel\r\n");
+      } else if (currentMode == MODE_LOCAL) {
+        text.append("Controls: [Space] Pause | [n] Next | [p] Prev | [s] Shuffle | [/] Search | [w] Save list | [+/-] Vol | [f/b] Seek | [y] YouTube | [q] Quit\r\n");
       } else {
-        buffer << "Controls: [Space] Pause | [u] New URL | [+/-] Vol | [f/b] Seek | [y] Back to Local | [q] Quit\r\n";
+        text.append("Controls: [Space] Pause | [u] New URL | [+/-] Vol | [f/b] Seek | [y] Back to Local | [q] Quit\r\n");
       }
 
-      // Clear from cursor to end of screen
-      buffer << "\033[J";
-
-      std::cout << buffer.str();
+      // Only the cells that differ from the last frame are sent, in a
+      // single write().
+      screen.resize(rows, cols);
+      screen.begin();
+      screen.write(text.data(), text.size());
+      frame.clear();
+      screen.present(frame);
+      // Anything still buffered in std::cout must reach the terminal first.
       std::cout.flush();
+      frame.writeTo(STDOUT_FILENO);
       dirty = false;
     }
-
-    std::this_thread::sleep_for(
-        std::chrono::milliseconds(100)); // slightly slower refresh
   }
 
   clearScreen();